@@ -52,6 +52,10 @@ int Main(int argc, const char *const argv[]) {
         ("help", "produce help message")
         ("capture", po::value<std::string>(), "single ip address to capture")
         ("config", po::value<std::string>(), "configuration file for client configuration")
+        ("queues", po::value<unsigned>()->default_value(1), "number of queues (and reader threads) on the tunnel device")
+        ("offload", po::bool_switch(), "read TSO super-packets from the tunnel device and segment them ourselves (packets written to it are still not coalesced)")
+        ("uring", po::bool_switch(), "use io_uring for the tunnel device if the kernel allows it")
+        ("batch", po::value<unsigned>()->default_value(1), "most packets read from the tunnel device to pass on together")
     ;
 
     po::store(po::parse_command_line(argc, argv, po::options_description()
@@ -97,7 +101,7 @@ int Main(int argc, const char *const argv[]) {
         orc_assert(system(("route -n add 10.7.0.4 " + argument + " " + device).c_str()) == 0);
 
         capture->Start(args["config"].as<std::string>());
-    });
+    }, args["queues"].as<unsigned>(), args["offload"].as<bool>(), args["uring"].as<bool>(), args["batch"].as<unsigned>());
 
     Thread().join();
     return 0;
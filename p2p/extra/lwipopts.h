@@ -2,16 +2,32 @@
 
 #define MEM_LIBC_MALLOC 1
 #define MEMP_MEM_MALLOC 1
-#define MEMP_NUM_NETCONN 32
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
 
 #define LWIP_UDP 1
 
 #define LWIP_TCP 1
-#define TCP_WND 0xffff
 #define LWIP_TCP_SACK_OUT 1
+#define LWIP_TCP_TIMESTAMPS 1
+
+#ifdef ORC_LWIP_THROUGHPUT
+/* servers and desktops: fill high bandwidth-delay paths and carry many flows */
+#define MEMP_NUM_NETCONN 1024
+#define MEMP_NUM_TCP_PCB 1024
+#define MEMP_NUM_UDP_PCB 1024
+#define TCP_MSS 1460
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 7
+#define TCP_WND (4 * 1024 * 1024)
+#define TCP_SND_BUF (4 * 1024 * 1024)
+/* lwIP insists this stays well below 0xffff even when the buffer is larger */
+#define TCP_SNDLOWAT (16 * TCP_MSS)
+#else
+#define MEMP_NUM_NETCONN 32
+#define TCP_WND 0xffff
 #define TCP_MSS 512
 #define TCP_SND_BUF 0xffff
-#define LWIP_TCP_TIMESTAMPS 1
+#endif
 
 #define LWIP_NETIF_API 1
 #define LWIP_HAVE_LOOPIF 1
@@ -56,6 +56,49 @@ Brick<32> Hash(const std::string &data) {
     return Hash(Subset(data));
 }
 
+uint64_t SipHash(const Brick<16> &key, const uint8_t *data, size_t size) {
+    uint64_t k0, k1;
+    memcpy(&k0, key.data(), sizeof(k0));
+    memcpy(&k1, key.data() + sizeof(k0), sizeof(k1));
+    boost::endian::little_to_native_inplace(k0);
+    boost::endian::little_to_native_inplace(k1);
+    uint64_t v0(k0 ^ 0x736f6d6570736575), v1(k1 ^ 0x646f72616e646f6d), v2(k0 ^ 0x6c7967656e657261), v3(k1 ^ 0x7465646279746573);
+
+    const auto round([&]() {
+        v0 += v1; v1 = v1 << 13 | v1 >> 51; v1 ^= v0; v0 = v0 << 32 | v0 >> 32;
+        v2 += v3; v3 = v3 << 16 | v3 >> 48; v3 ^= v2;
+        v0 += v3; v3 = v3 << 21 | v3 >> 43; v3 ^= v0;
+        v2 += v1; v1 = v1 << 17 | v1 >> 47; v1 ^= v2; v2 = v2 << 32 | v2 >> 32;
+    });
+
+    const auto compress([&](uint64_t word) {
+        v3 ^= word;
+        round();
+        round();
+        v0 ^= word;
+    });
+
+    uint64_t last(uint64_t(size) << 56);
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        compress(boost::endian::little_to_native(word));
+    }
+    for (size_t i(0); i != size; ++i)
+        last |= uint64_t(data[i]) << i * 8;
+    compress(last);
+
+    v2 ^= 0xff;
+    for (unsigned i(0); i != 4; ++i)
+        round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t SipHash(const uint8_t *data, size_t size) {
+    static const auto key(Random<16>());
+    return SipHash(key, data, size);
+}
+
 
 Signature::Signature(const Brick<65> &data) {
     std::tie(r_, s_, v_) = Take<Brick<32>, Brick<32>, Number<uint8_t>>(data);
@@ -43,6 +43,18 @@ Brick<Size_> Random() {
 Brick<32> Hash(const Buffer &data);
 Brick<32> Hash(const std::string &data);
 
+// SipHash-2-4, which is only as unpredictable as its key
+uint64_t SipHash(const Brick<16> &key, const uint8_t *data, size_t size);
+uint64_t SipHash(const uint8_t *data, size_t size);
+
+// for unordered containers keyed by whatever a peer sends, which would otherwise get to pick the buckets
+struct Keyed {
+    template <size_t Size_>
+    size_t operator ()(const Brick<Size_> &value) const noexcept {
+        return SipHash(value.data(), value.size());
+    }
+};
+
 struct Signature {
     Brick<32> r_;
     Brick<32> s_;
@@ -25,6 +25,7 @@
 
 #include <sqlite3.h>
 
+#include "buffer.hpp"
 #include "shared.hpp"
 
 #define orc_sqlstep(expr) ({ \
@@ -87,6 +88,8 @@ class Statement {
     // NOLINTNEXTLINE (cppcoreguidelines-pro-type-cstyle-cast)
     orc_bind(text, const std::string_view, value.data(), value.size(), SQLITE_TRANSIENT)
 
+    orc_bind(blob, const Region &, value.data(), value.size(), SQLITE_TRANSIENT)
+
   public:
     Statement() :
         statement_(nullptr)
@@ -100,19 +103,18 @@ class Statement {
         orc_sqlcall(sqlite3_prepare_v2(database_, code, -1, &statement_, nullptr));
     }
 
-    ~Statement() { try {
+    ~Statement() {
+        // this (like sqlite3_reset) repeats whatever the last step failed with, which was already thrown
         if (statement_ != nullptr)
-            orc_sqlcall(sqlite3_finalize(statement_));
-    } catch (...) {
-        orc_insist(false);
-    } }
+            sqlite3_finalize(statement_);
+    }
 
     operator sqlite3_stmt *() const {
         return statement_;
     }
 
     Results_ operator ()(const Args_ &...args) {
-        orc_sqlcall(sqlite3_reset(statement_));
+        sqlite3_reset(statement_);
         orc_sqlcall(sqlite3_clear_bindings(statement_));
         Bind<1>(args...);
         return Results_(database_, *this);
@@ -162,6 +164,70 @@ class One final :
     }
 };
 
+template <typename Type_>
+struct Column;
+
+template <>
+struct Column<int32_t> {
+    static int32_t Get(sqlite3_stmt *statement, int index) {
+        return sqlite3_column_int(statement, index);
+    }
+};
+
+template <>
+struct Column<sqlite3_int64> {
+    static sqlite3_int64 Get(sqlite3_stmt *statement, int index) {
+        return sqlite3_column_int64(statement, index);
+    }
+};
+
+template <>
+struct Column<double> {
+    static double Get(sqlite3_stmt *statement, int index) {
+        return sqlite3_column_double(statement, index);
+    }
+};
+
+template <>
+struct Column<std::string> {
+    static std::string Get(sqlite3_stmt *statement, int index) {
+        const auto data(sqlite3_column_text(statement, index));
+        if (data == nullptr)
+            return {};
+        return {reinterpret_cast<const char *>(data), size_t(sqlite3_column_bytes(statement, index))};
+    }
+};
+
+template <>
+struct Column<Beam> {
+    static Beam Get(sqlite3_stmt *statement, int index) {
+        const auto data(sqlite3_column_blob(statement, index));
+        return {data, size_t(sqlite3_column_bytes(statement, index))};
+    }
+};
+
+template <typename... Columns_>
+class Rows final :
+    public std::vector<std::tuple<Columns_...>>
+{
+  private:
+    template <size_t... Indices_>
+    static std::tuple<Columns_...> Get(sqlite3_stmt *statement, std::index_sequence<Indices_...>) {
+        return {Column<Columns_>::Get(statement, Indices_)...};
+    }
+
+  public:
+    Rows(Database &database_, sqlite3_stmt *statement) {
+        for (;;) {
+            const auto step(orc_sqlstep(sqlite3_step(statement)));
+            if (step == SQLITE_DONE)
+                break;
+            orc_assert(step == SQLITE_ROW);
+            this->emplace_back(Get(statement, std::index_sequence_for<Columns_...>()));
+        }
+    }
+};
+
 }
 
 #endif//ORCHID_DATABASE_HPP
@@ -23,6 +23,9 @@
 #ifndef ORCHID_DRAIN_HPP
 #define ORCHID_DRAIN_HPP
 
+#include <type_traits>
+#include <vector>
+
 #include "valve.hpp"
 
 namespace orc {
@@ -39,6 +42,12 @@ class Drain :
 {
   public:
     virtual void Land(Type_ data) = 0;
+
+    // whatever a reader picked up in one go; taking them one at a time is always correct
+    virtual void Flood(const std::vector<std::remove_reference_t<Type_> *> &data) {
+        for (const auto item : data)
+            Land(*item);
+    }
 };
 
 template <typename Type_>
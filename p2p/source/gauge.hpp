@@ -36,17 +36,18 @@ class Origin;
 static const uint256_t Gwei(1000000000);
 
 class Gauge {
-  private:
+  public:
     typedef std::map<unsigned, double> Prices_;
 
+  private:
     static task<S<Prices_>> Update_(Origin &origin);
     S<Updated<S<Prices_>>> prices_;
 
   public:
-    Gauge(unsigned milliseconds, const S<Origin> &origin) :
+    Gauge(unsigned milliseconds, const S<Origin> &origin, S<Prices_> prices = nullptr) :
         prices_(Update(milliseconds, [origin]() -> task<S<Prices_>> {
             co_return co_await Update_(*origin);
-        }))
+        }, prices == nullptr ? std::nullopt : std::optional(std::move(prices))))
     {
     }
 
@@ -626,4 +626,17 @@ uint256_t Monotonic();
 
 }
 
+namespace std {
+
+// addresses are the tail of a hash, so their low bits are already well distributed
+template <>
+struct hash<orc::Address> {
+    size_t operator ()(const orc::Address &value) const noexcept {
+        static const orc::uint160_t mask(~uint64_t(0));
+        return (static_cast<const orc::uint160_t &>(value) & mask).convert_to<uint64_t>();
+    }
+};
+
+}
+
 #endif//ORCHID_JSONRPC_HPP
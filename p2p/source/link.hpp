@@ -37,6 +37,12 @@ class Pipe {
   public:
     virtual ~Pipe() = default;
     virtual task<void> Send(const Type_ &data) = 0;
+
+    // several at once, for the far side to write back to back; sending them one at a time is always correct
+    virtual task<void> Pour(const std::vector<const Type_ *> &data) {
+        for (const auto item : data)
+            co_await Send(*item);
+    }
 };
 
 template <typename Basin_>
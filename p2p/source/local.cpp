@@ -20,13 +20,34 @@
 /* }}} */
 
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
 #include <p2p/base/basic_packet_socket_factory.h>
 
 #include "connection.hpp"
+#include "event.hpp"
 #include "local.hpp"
+#include "locked.hpp"
 #include "manager.hpp"
 #include "port.hpp"
+#include "sleep.hpp"
 #include "spawn.hpp"
+#include "syscall.hpp"
 
 namespace orc {
 
@@ -35,12 +56,305 @@ class LocalOpening final :
 {
   private:
     asio::ip::udp::socket connection_;
+    // datagrams moved per system call; 1 keeps to plain asio (as does anything but Linux)
+    [[maybe_unused]] const unsigned batch_;
+    // segmentation offload (UDP_SEGMENT/UDP_GRO) if the kernel has it
+    [[maybe_unused]] const bool offload_;
+
+#ifdef __linux__
+    // the kernel refuses to cut one send into more than this (UDP_MAX_SEGMENTS)
+    static const size_t Segments_ = 64;
+    static const size_t Coalesced_ = 65507;
+
+    bool gso_ = false;
+    bool gro_ = false;
+    // cleared for good once the kernel (or a seccomp policy) refuses sendmmsg
+    std::atomic<bool> mmsg_ = true;
+
+    // a sender parks one of these (and keeps its own buffer) until a batch including it is sent
+    struct Pending {
+        const Buffer &data_;
+        const asio::ip::udp::endpoint endpoint_;
+        Event sent_;
+        // fired once the sender has its result or has been handed the queue, whichever is first
+        Event woken_;
+    };
+
+    struct Locked_ {
+        std::deque<Pending *> pending_;
+        bool busy_ = false;
+    }; Locked<Locked_> locked_;
+
+    void Probe() {
+        if (!offload_ || batch_ == 1)
+            return;
+        const auto file(connection_.native_handle());
+        int value(1);
+        gro_ = setsockopt(file, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+        socklen_t size(sizeof(value));
+        gso_ = getsockopt(file, SOL_UDP, UDP_SEGMENT, &value, &size) == 0;
+    }
+
+    // false means the kernel does not support recvmmsg, so the caller should fall back
+    task<bool> Receive() {
+        // with GRO on, one read can be many datagrams glued together
+        const size_t size(gro_ ? 0x10000 : 2048);
+        typedef std::array<uint8_t, CMSG_SPACE(sizeof(int))> Control;
+
+        const auto file(connection_.native_handle());
+        Beam beam(batch_ * size);
+        std::vector<asio::ip::udp::endpoint> endpoints(batch_);
+        std::vector<iovec> vectors(batch_);
+        std::vector<Control> controls(batch_);
+        std::vector<mmsghdr> messages(batch_);
+
+        // consecutive failures other than EAGAIN, which (as with ENOBUFS) might not go away on their own
+        unsigned failures(0);
+
+        for (;;) {
+            for (unsigned i(0); i != batch_; ++i) {
+                vectors[i] = {beam.data() + i * size, size};
+                messages[i] = {.msg_hdr = {
+                    .msg_name = endpoints[i].data(), .msg_namelen = socklen_t(endpoints[i].capacity()),
+                    .msg_iov = &vectors[i], .msg_iovlen = 1,
+                    .msg_control = controls[i].data(), .msg_controllen = controls[i].size(),
+                }};
+            }
+
+            int count;
+            if (orc_ignore({ count = orc_syscall(recvmmsg(file, messages.data(), batch_, MSG_DONTWAIT, nullptr), EAGAIN, ENOSYS, EPERM); })) {
+                if (!connection_.is_open())
+                    co_return true;
+                co_await Sleep(std::min(1u << std::min(failures++, 10u), 1000u));
+                continue;
+            }
+
+            failures = 0;
+
+            if (count == -ENOSYS || count == -EPERM) {
+                if (gro_) {
+                    int value(0);
+                    orc_assert(setsockopt(file, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0);
+                }
+                co_return false;
+            }
+
+            if (count == -EAGAIN) {
+                try {
+                    co_await connection_.async_wait(asio::socket_base::wait_read, Token());
+                } catch (const asio::system_error &error) {
+                    orc_ignore({ orc_adapt(error); });
+                    if (!connection_.is_open())
+                        co_return true;
+                }
+                continue;
+            }
+
+            for (int i(0); i != count; ++i) {
+                auto &message(messages[i].msg_hdr);
+                auto &endpoint(endpoints[i]);
+                endpoint.resize(message.msg_namelen);
+
+                const size_t writ(messages[i].msg_len);
+                size_t segment(writ);
+                for (auto control(CMSG_FIRSTHDR(&message)); control != nullptr; control = CMSG_NXTHDR(&message, control))
+                    if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO) {
+                        int value;
+                        memcpy(&value, CMSG_DATA(control), sizeof(value));
+                        if (value > 0)
+                            segment = value;
+                    }
+
+                const auto data(beam.data() + i * size);
+                for (size_t offset(0); offset < writ || offset == 0; offset += segment) {
+                    Subset subset(data + offset, std::min(segment, writ - offset));
+                    if (Verbose)
+                        Log() << "\e[33mRECV " << subset.size() << " " << subset << "\e[0m" << std::endl;
+                    drain_.Land(subset, endpoint);
+                    if (segment == 0)
+                        break;
+                }
+            }
+        }
+    }
+
+    // the flusher reports every result through here, so the sender wakes up even if it was never handed the queue
+    static void Sent(Pending *pending, const std::exception_ptr &error = nullptr) noexcept {
+        if (error != nullptr)
+            (pending->sent_)(error);
+        else
+            (pending->sent_)();
+        if (!pending->woken_)
+            (pending->woken_)();
+    }
+
+    // what Send does without batching, for when sendmmsg turns out to be unavailable
+    task<void> Single(Pending *pending) noexcept {
+        std::exception_ptr error;
+        try {
+            const auto writ(co_await connection_.async_send_to(Sequence(pending->data_), pending->endpoint_, Token()));
+            orc_assert_(writ == pending->data_.size(), "orc_assert(" << writ << " {writ} == " << pending->data_.size() << " {data.size()})");
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        Sent(pending, error);
+    }
+
+    // whoever finds nobody sending drains the queue, batch_ datagrams to a call, on behalf of everyone parked ahead of it;
+    // once its own datagram is out it hands the queue to the next sender in line, so nobody sends for everyone else forever
+    task<void> Flush(Pending &own) noexcept {
+        typedef std::array<uint8_t, CMSG_SPACE(sizeof(uint16_t))> Control;
+
+        const auto file(connection_.native_handle());
+        std::vector<Pending *> batch;
+        std::vector<iovec> vectors;
+        std::vector<size_t> offsets;
+        // [first, last) of batch, each sent as a single message
+        std::vector<std::pair<size_t, size_t>> groups;
+        std::vector<Control> controls;
+        std::vector<mmsghdr> messages;
+
+        // with GSO, a run of datagrams to one place of one size (but for a shorter last one) is handed over as one message for the kernel to cut
+        const auto build([&](size_t from) {
+            groups.clear();
+            size_t segment(0), total(0);
+            bool closed(true);
+            for (auto i(from); i != batch.size(); ++i) {
+                const auto size(batch[i]->data_.size());
+                if (gso_ && !closed && size != 0 && size <= segment && batch[i]->endpoint_ == batch[i - 1]->endpoint_ &&
+                    i - groups.back().first != Segments_ && total + size <= Coalesced_
+                ) {
+                    groups.back().second = i + 1;
+                    total += size;
+                    closed = size != segment;
+                } else {
+                    groups.emplace_back(i, i + 1);
+                    segment = size;
+                    total = size;
+                    closed = false;
+                }
+            }
+
+            messages.resize(groups.size());
+            controls.resize(groups.size());
+            for (size_t i(0); i != groups.size(); ++i) {
+                const auto [first, last] = groups[i];
+                const auto &endpoint(batch[first]->endpoint_);
+                auto &message(messages[i].msg_hdr);
+                // NOLINTNEXTLINE (cppcoreguidelines-pro-type-const-cast)
+                message = {
+                    .msg_name = const_cast<sockaddr *>(endpoint.data()), .msg_namelen = socklen_t(endpoint.size()),
+                    .msg_iov = vectors.data() + offsets[first], .msg_iovlen = offsets[last] - offsets[first],
+                };
+
+                if (last - first == 1)
+                    continue;
+                message.msg_control = controls[i].data();
+                message.msg_controllen = controls[i].size();
+                const auto control(CMSG_FIRSTHDR(&message));
+                control->cmsg_level = SOL_UDP;
+                control->cmsg_type = UDP_SEGMENT;
+                control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                const uint16_t segment(batch[first]->data_.size());
+                memcpy(CMSG_DATA(control), &segment, sizeof(segment));
+            }
+        });
+
+        for (;;) {
+            batch.clear();
+            Pending *next(nullptr);
+            { const auto locked(locked_());
+                if (!own.sent_)
+                    while (batch.size() != batch_ && !locked->pending_.empty()) {
+                        batch.emplace_back(locked->pending_.front());
+                        locked->pending_.pop_front();
+                    }
+                else if (!locked->pending_.empty())
+                    next = locked->pending_.front();
+                else
+                    locked->busy_ = false; }
+
+            if (batch.empty()) {
+                if (next != nullptr)
+                    (next->woken_)();
+                co_return;
+            }
+
+            vectors.clear();
+            offsets.clear();
+            for (const auto pending : batch) {
+                offsets.emplace_back(vectors.size());
+                pending->data_.each([&](const uint8_t *data, size_t size) {
+                    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-const-cast)
+                    vectors.push_back({const_cast<uint8_t *>(data), size});
+                    return true;
+                });
+            }
+            offsets.emplace_back(vectors.size());
+
+            if (!mmsg_) {
+                for (const auto pending : batch)
+                    co_await Single(pending);
+                continue;
+            }
+
+            build(0);
+            for (size_t sent(0); sent != groups.size(); ) {
+                int count;
+                try {
+                    count = orc_syscall(sendmmsg(file, messages.data() + sent, groups.size() - sent, MSG_DONTWAIT), EAGAIN, ENOSYS, EPERM);
+                } catch (...) {
+                    // sendmmsg only fails outright on the first message, which is the one to blame
+                    const auto [first, last] = groups[sent];
+                    if (last - first != 1 && std::exchange(gso_, false)) {
+                        // the device can refuse segmentation (EIO without checksum offload), so send those one by one
+                        build(first);
+                        sent = 0;
+                        continue;
+                    }
+
+                    for (auto i(first); i != last; ++i)
+                        Sent(batch[i], std::current_exception());
+                    ++sent;
+                    continue;
+                }
+
+                if (count == -ENOSYS || count == -EPERM) {
+                    // a firewall rejecting one datagram also says EPERM, but then the fallback just reports it as well
+                    mmsg_ = false;
+                    for (auto i(groups[sent].first); i != batch.size(); ++i)
+                        co_await Single(batch[i]);
+                    sent = groups.size();
+                    continue;
+                }
+
+                if (count == -EAGAIN) {
+                    try {
+                        co_await connection_.async_wait(asio::socket_base::wait_write, Token());
+                    } catch (...) {
+                        for (auto i(groups[sent].first); i != batch.size(); ++i)
+                            Sent(batch[i], std::current_exception());
+                        sent = groups.size();
+                    }
+                    continue;
+                }
+
+                for (const auto end(sent + count); sent != end; ++sent)
+                    for (auto i(groups[sent].first); i != groups[sent].second; ++i)
+                        Sent(batch[i]);
+            }
+        }
+    }
+#endif
 
   public:
     template <typename... Args_>
-    LocalOpening(BufferSewer &drain, Args_ &&...args) :
+    LocalOpening(BufferSewer &drain, unsigned batch, bool offload, Args_ &&...args) :
         Opening(drain),
-        connection_(Context(), std::forward<Args_>(args)...)
+        connection_(Context(), std::forward<Args_>(args)...),
+        batch_(batch == 0 ? 1 : batch),
+        offload_(offload)
     {
     }
 
@@ -53,7 +367,18 @@ class LocalOpening final :
     }
 
     void Open() {
+#ifdef __linux__
+        Probe();
+#endif
+
         Spawn([this]() noexcept -> task<void> {
+#ifdef __linux__
+            if (batch_ != 1 && co_await Receive()) {
+                Stop();
+                co_return;
+            }
+#endif
+
             for (;;) {
                 // XXX: use Beam.subset
                 char data[2048];
@@ -89,24 +414,41 @@ class LocalOpening final :
     }
 
     task<void> Send(const Buffer &data, const Socket &socket) override {
+#ifdef __linux__
+        if (batch_ != 1 && mmsg_) {
+            Pending pending{data, {socket.Host(), socket.Port()}};
+            bool flush;
+            { const auto locked(locked_());
+                locked->pending_.emplace_back(&pending);
+                flush = !std::exchange(locked->busy_, true); }
+            if (!flush)
+                co_await *pending.woken_;
+            if (!pending.sent_)
+                co_await Flush(pending);
+            co_return co_await *pending.sent_;
+        }
+#endif
+
         const auto writ(co_await connection_.async_send_to(Sequence(data), {socket.Host(), socket.Port()}, Token()));
         orc_assert_(writ == data.size(), "orc_assert(" << writ << " {writ} == " << data.size() << " {data.size()})");
     }
 };
 
-Local::Local(U<rtc::NetworkManager> manager) :
-    Origin(std::move(manager))
+Local::Local(U<rtc::NetworkManager> manager, unsigned batch, bool offload) :
+    Origin(std::move(manager)),
+    batch_(batch),
+    offload_(offload)
 {
     type_ = typeid(*this).name();
 }
 
-Local::Local(const class Host &host) :
-    Local(std::make_unique<Assistant>(host))
+Local::Local(const class Host &host, unsigned batch, bool offload) :
+    Local(std::make_unique<Assistant>(host), batch, offload)
 {
 }
 
-Local::Local() :
-    Local(std::make_unique<Manager>())
+Local::Local(unsigned batch, bool offload) :
+    Local(std::make_unique<Manager>(), batch, offload)
 {
 }
 
@@ -139,7 +481,7 @@ task<void> Local::Associate(BufferSunk &sunk, const Socket &endpoint) {
 }
 
 task<Socket> Local::Unlid(Sunk<BufferSewer, Opening> &sunk) {
-    auto &opening(sunk.Wire<LocalOpening>());
+    auto &opening(sunk.Wire<LocalOpening>(batch_, offload_));
     opening.Open({asio::ip::address_v4::any(), 0});
     co_return opening.Local();
 }
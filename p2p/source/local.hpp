@@ -31,10 +31,15 @@ class Local final :
     public Origin
 {
   private:
-    Local(U<rtc::NetworkManager> manager);
+    // datagrams per recvmmsg/sendmmsg on Linux; 1 disables batching
+    const unsigned batch_;
+    // UDP_SEGMENT/UDP_GRO on top of batching, where the kernel supports them
+    const bool offload_;
+
+    Local(U<rtc::NetworkManager> manager, unsigned batch, bool offload);
   public:
-    Local(const class Host &host);
-    Local();
+    Local(const class Host &host, unsigned batch = 1, bool offload = false);
+    Local(unsigned batch = 1, bool offload = false);
 
     class Host Host() override;
 
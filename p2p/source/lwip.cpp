@@ -32,8 +32,11 @@
 #endif
 
 #include <lwip/opt.h>
+#include <lwip/api.h>
+#include <lwip/priv/sockets_priv.h>
 #include <lwip/sockets.h>
 #include <lwip/sys.h>
+#include <lwip/tcpip.h>
 
 #ifndef TCP_NODELAY
 #define TCP_NODELAY    0x01    /* don't delay send to coalesce packets */
@@ -69,6 +72,7 @@
 
 #include <algorithm>
 #include <map>
+#include <vector>
 
 #include "rtc_base/arraysize.h"
 #include "rtc_base/byte_order.h"
@@ -591,6 +595,19 @@ uint32_t SocketDispatcher::GetRequestedEvents() {
   return enabled_events();
 }
 
+// Nothing calls back when an event is (re)enabled for a level that was already
+// reached, so check again; disabling is simply masked off when processing.
+void SocketDispatcher::SetEnabledEvents(uint8_t events) {
+  LwipSocket::SetEnabledEvents(events);
+  if (events != 0)
+    ss_->Update(this);
+}
+
+void SocketDispatcher::EnableEvents(uint8_t events) {
+  LwipSocket::EnableEvents(events);
+  ss_->Update(this);
+}
+
 void SocketDispatcher::OnPreEvent(uint32_t ff) {
   if ((ff & DE_CONNECT) != 0)
     state_ = CS_CONNECTED;
@@ -633,102 +650,65 @@ int SocketDispatcher::Close() {
   return LwipSocket::Close();
 }
 
-class EventDispatcher : public Dispatcher {
- public:
-  EventDispatcher(LwipSocketServer* ss) : ss_(ss), fSignaled_(false) {
-    afd_[0] = ::lwip_socket(PF_INET, SOCK_DGRAM, 0);
-    if (afd_[0] < 0)
-      RTC_LOG(LERROR) << "pipe 1 failed";
-    afd_[1] = ::lwip_socket(PF_INET, SOCK_DGRAM, 0);
-    if (afd_[1] < 0)
-      RTC_LOG(LERROR) << "pipe 2 failed";
-    struct sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = 0;
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-    int r = ::lwip_bind(afd_[0], (const struct sockaddr *)&addr, sizeof(addr));
-    if (r < 0)
-        RTC_LOG(LERROR) << "pipe bind failed";
-    socklen_t addrlen = sizeof(addr);
-    r = ::lwip_getsockname(afd_[0], (struct sockaddr *)&addr, &addrlen);
-    if (r < 0)
-        RTC_LOG(LERROR) << "pipe getsockaddr failed";
-    r = ::lwip_connect(afd_[1], (const struct sockaddr *)&addr, addrlen);
-    if (r < 0)
-        RTC_LOG(LERROR) << "pipe connect failed";
-    ss_->Add(this);
-  }
-
-  ~EventDispatcher() override {
-    ss_->Remove(this);
-    ::lwip_close(afd_[0]);
-    ::lwip_close(afd_[1]);
-  }
-
-  virtual void Signal() {
-    CritScope cs(&crit_);
-    if (!fSignaled_) {
-      const uint8_t b[1] = {0};
-      const ssize_t res = ::lwip_send(afd_[1], b, sizeof(b), 0);
-      RTC_DCHECK_EQ(1, res);
-      fSignaled_ = true;
-    }
-  }
-
-  uint32_t GetRequestedEvents() override { return DE_READ; }
-
-  void OnPreEvent(uint32_t ff) override {
-    // It is not possible to perfectly emulate an auto-resetting event with
-    // pipes.  This simulates it by resetting before the event is handled.
-
-    CritScope cs(&crit_);
-    if (fSignaled_) {
-      uint8_t b[4];  // Allow for reading more than 1 byte, but expect 1.
-      const ssize_t res = ::lwip_recv(afd_[0], b, sizeof(b), 0);
-      RTC_DCHECK_EQ(1, res);
-      fSignaled_ = false;
-    }
-  }
-
-  void OnEvent(uint32_t ff, int err) override { RTC_NOTREACHED(); }
-
-  int GetDescriptor() override { return afd_[0]; }
-
-  bool IsDescriptorClosed() override { return false; }
-
- private:
-  LwipSocketServer* ss_;
-  int afd_[2];
-  bool fSignaled_;
-  CriticalSection crit_;
+// lwIP's sockets layer keeps its own state (what select would look at) up to
+// date from the netconn callback; ours wraps it, and afterwards tells whoever
+// is watching that socket that it is worth another look.
+struct Watch {
+  LwipSocketServer* ss;
+  Dispatcher* dispatcher;
 };
 
-// Sets the value of a boolean value to false when signaled.
-class Signaler : public EventDispatcher {
- public:
-  Signaler(LwipSocketServer* ss, bool* pf) : EventDispatcher(ss), pf_(pf) {}
-  ~Signaler() override {}
-
-  void OnEvent(uint32_t ff, int err) override {
-    if (pf_)
-      *pf_ = false;
+static std::mutex watches_mutex_;
+static std::map<struct netconn*, Watch> watches_;
+static netconn_callback original_ = nullptr;
+
+static void Callback(struct netconn* conn, enum netconn_evt evt, u16_t len) {
+  // Connections accepted from a watched listener inherit this callback before
+  // anyone has wrapped them, so there might not be a watch (yet).
+  original_(conn, evt, len);
+  std::lock_guard<std::mutex> lock(watches_mutex_);
+  auto watch = watches_.find(conn);
+  if (watch != watches_.end())
+    watch->second.ss->Ready(watch->second.dispatcher);
+}
+
+// The same levels lwip_select would compute for this descriptor.
+static void Levels(int fd, bool* readable, bool* writable) {
+  struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+  if (sock == nullptr) {
+    // Closed underneath us: report it readable so IsDescriptorClosed notices.
+    *readable = true;
+    *writable = false;
+    return;
   }
-
- private:
-  bool* pf_;
-};
-
-LwipSocketServer::LwipSocketServer() : fWait_(false) {
-  signal_wakeup_ = new Signaler(this, &fWait_);
+  SYS_ARCH_DECL_PROTECT(lev);
+  SYS_ARCH_PROTECT(lev);
+  *readable = sock->lastdata.pbuf != nullptr || sock->rcvevent > 0;
+  *writable = sock->sendevent != 0;
+  SYS_ARCH_UNPROTECT(lev);
 }
 
+LwipSocketServer::LwipSocketServer()
+    : wakeup_(/*manual_reset=*/false, /*initially_signaled=*/false) {}
+
 LwipSocketServer::~LwipSocketServer() {
-  delete signal_wakeup_;
   RTC_DCHECK(dispatchers_.empty());
 }
 
 void LwipSocketServer::WakeUp() {
-  signal_wakeup_->Signal();
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    woken_ = true;
+  }
+  wakeup_.Set();
+}
+
+void LwipSocketServer::Ready(Dispatcher* pdispatcher) {
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.insert(pdispatcher);
+  }
+  wakeup_.Set();
 }
 
 Socket* LwipSocketServer::CreateSocket(int family, int type) {
@@ -762,7 +742,27 @@ AsyncSocket* LwipSocketServer::WrapSocket(SOCKET s) {
 }
 
 void LwipSocketServer::Add(Dispatcher* pdispatcher) {
+  struct lwip_sock* sock =
+      lwip_socket_dbg_get_socket(pdispatcher->GetDescriptor());
+  RTC_DCHECK(sock != nullptr);
+  struct netconn* conn = sock->conn;
+  LOCK_TCPIP_CORE();
+  if (conn->callback != &Callback) {
+    RTC_DCHECK(original_ == nullptr || original_ == conn->callback);
+    original_ = conn->callback;
+    conn->callback = &Callback;
+  }
+  UNLOCK_TCPIP_CORE();
+  {
+    std::lock_guard<std::mutex> lock(watches_mutex_);
+    watches_[conn] = Watch{this, pdispatcher};
+  }
+
   CritScope cs(&crit_);
+  watched_[pdispatcher] = conn;
+  // Whatever happened before the watch was in place (such as data arriving on
+  // a freshly accepted connection) still needs a look.
+  Ready(pdispatcher);
   if (processing_dispatchers_) {
     // A dispatcher is being added while a "Wait" call is processing the
     // list of socket events.
@@ -777,6 +777,19 @@ void LwipSocketServer::Add(Dispatcher* pdispatcher) {
 
 void LwipSocketServer::Remove(Dispatcher* pdispatcher) {
   CritScope cs(&crit_);
+  auto watched = watched_.find(pdispatcher);
+  if (watched != watched_.end()) {
+    // Once this is gone, a callback in flight can no longer reach us.
+    {
+      std::lock_guard<std::mutex> lock(watches_mutex_);
+      watches_.erase(watched->second);
+    }
+    watched_.erase(watched);
+  }
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.erase(pdispatcher);
+  }
   if (processing_dispatchers_) {
     // A dispatcher is being removed while a "Wait" call is processing the
     // list of socket events.
@@ -800,6 +813,7 @@ void LwipSocketServer::Remove(Dispatcher* pdispatcher) {
 }
 
 void LwipSocketServer::Update(Dispatcher* pdispatcher) {
+  Ready(pdispatcher);
 }
 
 void LwipSocketServer::AddRemovePendingDispatchers() {
@@ -818,10 +832,6 @@ void LwipSocketServer::AddRemovePendingDispatchers() {
   }
 }
 
-bool LwipSocketServer::Wait(int cmsWait, bool process_io) {
-  return WaitSelect(cmsWait, process_io);
-}
-
 static void ProcessEvents(Dispatcher* dispatcher,
                           bool readable,
                           bool writable,
@@ -871,125 +881,62 @@ static void ProcessEvents(Dispatcher* dispatcher,
   }
 }
 
-bool LwipSocketServer::WaitSelect(int cmsWait, bool process_io) {
-  // Calculate timing information
-
-  struct timeval* ptvWait = nullptr;
-  struct timeval tvWait;
-  int64_t stop_us;
-  if (cmsWait != kForever) {
-    // Calculate wait timeval
-    tvWait.tv_sec = cmsWait / 1000;
-    tvWait.tv_usec = (cmsWait % 1000) * 1000;
-    ptvWait = &tvWait;
-
-    // Calculate when to return
-    stop_us = rtc::TimeMicros() + cmsWait * 1000;
-  }
-
-  // Zero all fd_sets. Don't need to do this inside the loop since
-  // select() zeros the descriptors not signaled
-
-  fd_set fdsRead;
-  FD_ZERO(&fdsRead);
-  fd_set fdsWrite;
-  FD_ZERO(&fdsWrite);
-// Explicitly unpoison these FDs on MemorySanitizer which doesn't handle the
-// inline assembly in FD_ZERO.
-// http://crbug.com/344505
-#ifdef MEMORY_SANITIZER
-  __msan_unpoison(&fdsRead, sizeof(fdsRead));
-  __msan_unpoison(&fdsWrite, sizeof(fdsWrite));
-#endif
-
-  fWait_ = true;
+bool LwipSocketServer::Wait(int cmsWait, bool process_io) {
+  const int64_t stop_ms =
+      cmsWait == kForever ? 0 : rtc::TimeMillis() + cmsWait;
 
-  while (fWait_) {
-    int fdmax = -1;
+  for (;;) {
+    std::vector<Dispatcher*> ready;
     {
-      CritScope cr(&crit_);
-      // TODO(jbauch): Support re-entrant waiting.
-      RTC_DCHECK(!processing_dispatchers_);
-      for (Dispatcher* pdispatcher : dispatchers_) {
-        // Query dispatchers for read and write wait state
-        RTC_DCHECK(pdispatcher);
-        if (!process_io && (pdispatcher != signal_wakeup_))
-          continue;
-        int fd = pdispatcher->GetDescriptor();
-        // "select"ing a file descriptor that is equal to or larger than
-        // FD_SETSIZE will result in undefined behavior.
-        RTC_DCHECK_LT(fd, FD_SETSIZE);
-        if (fd > fdmax)
-          fdmax = fd;
-
-        uint32_t ff = pdispatcher->GetRequestedEvents();
-        if (ff & (DE_READ | DE_ACCEPT))
-          FD_SET(fd, &fdsRead);
-        if (ff & (DE_WRITE | DE_CONNECT))
-          FD_SET(fd, &fdsWrite);
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      if (woken_) {
+        woken_ = false;
+        return true;
+      }
+      if (process_io) {
+        ready.assign(ready_.begin(), ready_.end());
+        ready_.clear();
       }
     }
 
-    // Wait then call handlers as appropriate
-    // < 0 means error
-    // 0 means timeout
-    // > 0 means count of descriptors ready
-    int n = ::lwip_select(fdmax + 1, &fdsRead, &fdsWrite, nullptr, ptvWait);
-
-    // If error, return error.
-    if (n < 0) {
-      if (errno != EINTR) {
-        RTC_LOG_E(LS_ERROR, EN, errno) << "select";
-        return false;
-      }
-      // Else ignore the error and keep going. If this EINTR was for one of the
-      // signals managed by this LwipSocketServer, the
-      // PosixSignalDeliveryDispatcher will be in the signaled state in the next
-      // iteration.
-    } else if (n == 0) {
-      // If timeout, return success
-      return true;
-    } else {
-      // We have signaled descriptors
+    if (!ready.empty()) {
       CritScope cr(&crit_);
+      // TODO(jbauch): Support re-entrant waiting.
+      RTC_DCHECK(!processing_dispatchers_);
       processing_dispatchers_ = true;
-      for (Dispatcher* pdispatcher : dispatchers_) {
-        int fd = pdispatcher->GetDescriptor();
+      for (Dispatcher* pdispatcher : ready) {
+        // Anything removed since it was marked is gone (or going).
+        if (pending_remove_dispatchers_.count(pdispatcher) != 0 ||
+            dispatchers_.count(pdispatcher) == 0)
+          continue;
 
-        bool readable = FD_ISSET(fd, &fdsRead);
-        if (readable) {
-          FD_CLR(fd, &fdsRead);
-        }
+        bool readable, writable;
+        Levels(pdispatcher->GetDescriptor(), &readable, &writable);
 
-        bool writable = FD_ISSET(fd, &fdsWrite);
-        if (writable) {
-          FD_CLR(fd, &fdsWrite);
-        }
+        uint32_t ff = pdispatcher->GetRequestedEvents();
+        readable = readable && (ff & (DE_READ | DE_ACCEPT)) != 0;
+        writable = writable && (ff & (DE_WRITE | DE_CONNECT)) != 0;
 
-        // The error code can be signaled through reads or writes.
+        // A handler that re-enables an event calls Update, which marks the
+        // dispatcher again; so level-triggered behavior matches select.
         ProcessEvents(pdispatcher, readable, writable, readable || writable);
       }
-
       processing_dispatchers_ = false;
-      // Process deferred dispatchers that have been added/removed while the
-      // events were handled above.
       AddRemovePendingDispatchers();
+      return true;
     }
 
-    // Recalc the time remaining to wait. Doing it here means it doesn't get
-    // calced twice the first time through the loop
-    if (ptvWait) {
-      ptvWait->tv_sec = 0;
-      ptvWait->tv_usec = 0;
-      int64_t time_left_us = stop_us - rtc::TimeMicros();
-      if (time_left_us > 0) {
-        ptvWait->tv_sec = time_left_us / rtc::kNumMicrosecsPerSec;
-        ptvWait->tv_usec = time_left_us % rtc::kNumMicrosecsPerSec;
-      }
+    int wait = kForever;
+    if (cmsWait != kForever) {
+      const int64_t left = stop_ms - rtc::TimeMillis();
+      if (left <= 0)
+        return true;
+      wait = static_cast<int>(left);
     }
-  }
 
-  return true;
+    // Set by Ready and WakeUp; a set that races us just means a spare pass.
+    wakeup_.Wait(wait);
+  }
 }
 
 }  // namespace rtc
@@ -22,17 +22,22 @@
 #ifndef ORCHID_LWIP_HPP
 #define ORCHID_LWIP_HPP
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
 #include "rtc_base/critical_section.h"
+#include "rtc_base/event.h"
 #include "rtc_base/net_helpers.h"
 #include "rtc_base/socket_server.h"
 #include "rtc_base/system/rtc_export.h"
 
 using namespace rtc;
 
+struct netconn;
+
 namespace orc {
 
 typedef int SOCKET;
@@ -46,8 +51,6 @@ enum DispatcherEvent {
   DE_ACCEPT = 0x0010,
 };
 
-class Signaler;
-
 class Dispatcher {
  public:
   virtual ~Dispatcher() = default;
@@ -79,21 +82,29 @@ class RTC_EXPORT LwipSocketServer : public SocketServer {
   void Remove(Dispatcher* dispatcher);
   void Update(Dispatcher* dispatcher);
 
+  // Marks a dispatcher as worth looking at on the next pass of Wait.
+  void Ready(Dispatcher* dispatcher);
+
  private:
   typedef std::set<Dispatcher*> DispatcherSet;
 
   void AddRemovePendingDispatchers();
 
-  bool WaitSelect(int cms, bool process_io);
-  static bool InstallSignal(int signum, void (*handler)(int));
-
   DispatcherSet dispatchers_;
   DispatcherSet pending_add_dispatchers_;
   DispatcherSet pending_remove_dispatchers_;
   bool processing_dispatchers_ = false;
-  Signaler* signal_wakeup_;
   CriticalSection crit_;
-  bool fWait_;
+
+  // Instead of polling every descriptor, lwIP tells us (from its netconn
+  // callback) which sockets changed; only those are checked. This lock is
+  // taken under the tcpip core lock, so nothing may be locked inside it.
+  std::mutex ready_mutex_;
+  DispatcherSet ready_;
+  bool woken_ = false;
+  rtc::Event wakeup_;
+
+  std::map<Dispatcher*, ::netconn*> watched_;
 };
 
 class LwipSocket : public AsyncSocket, public sigslot::has_slots<> {
@@ -200,6 +211,10 @@ class SocketDispatcher : public Dispatcher, public LwipSocket {
   void OnEvent(uint32_t ff, int err) override;
 
   int Close() override;
+
+ protected:
+  void SetEnabledEvents(uint8_t events) override;
+  void EnableEvents(uint8_t events) override;
 };
 
 }
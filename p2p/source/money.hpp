@@ -0,0 +1,159 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_MONEY_HPP
+#define ORCHID_MONEY_HPP
+
+#include "error.hpp"
+#include "float.hpp"
+#include "integer.hpp"
+#include "signed.hpp"
+
+namespace orc {
+
+// an exact amount of currency, kept as a count of 10^-30 units: fine enough to price a single byte or a
+// single wei, and still able to hold balances up to about 10^8; values round to the nearest unit on the
+// way in from Float, and every operation on the way through truncates toward zero (as Float -> integer did)
+class Money {
+  private:
+    typedef __int128 Value_;
+    typedef unsigned __int128 Magnitude_;
+
+    static constexpr Value_ Scale_ = Value_(1000000000000000) * 1000000000000000;
+
+    Value_ value_;
+
+    static checked_int256_t Wide(Value_ value) {
+        const auto magnitude(value < 0 ? -Magnitude_(value) : Magnitude_(value));
+        checked_int256_t wide(uint64_t(magnitude >> 64));
+        wide <<= 64;
+        wide += uint64_t(magnitude);
+        return value < 0 ? checked_int256_t(-wide) : wide;
+    }
+
+    static Value_ Narrow(const checked_int256_t &value) {
+        const checked_int256_t magnitude(abs(value));
+        orc_assert_((magnitude >> 127) == 0, "money overflow " << value);
+        const auto narrow((Magnitude_((magnitude >> 64).convert_to<uint64_t>()) << 64) | Magnitude_((magnitude & checked_int256_t(~uint64_t(0))).convert_to<uint64_t>()));
+        return value.sign() < 0 ? -Value_(narrow) : Value_(narrow);
+    }
+
+    static Money Raw(Value_ value) {
+        Money money;
+        money.value_ = value;
+        return money;
+    }
+
+  public:
+    constexpr Money() noexcept :
+        value_(0)
+    {
+    }
+
+    explicit Money(const Float &value) :
+        value_([&]() {
+            static const Float scale(Wide(Scale_));
+            return Narrow(checked_int256_t(round(value * scale)));
+        }())
+    {
+    }
+
+    explicit operator Float() const {
+        static const Float scale(Wide(Scale_));
+        return Float(Wide(value_)) / scale;
+    }
+
+    Money operator -() const {
+        return Raw(-value_);
+    }
+
+    Money &operator +=(const Money &rhs) {
+        orc_assert_(!__builtin_add_overflow(value_, rhs.value_, &value_), "money overflow");
+        return *this;
+    }
+
+    Money &operator -=(const Money &rhs) {
+        orc_assert_(!__builtin_sub_overflow(value_, rhs.value_, &value_), "money overflow");
+        return *this;
+    }
+
+    Money operator +(const Money &rhs) const {
+        auto value(*this);
+        return value += rhs;
+    }
+
+    Money operator -(const Money &rhs) const {
+        auto value(*this);
+        return value -= rhs;
+    }
+
+    // the common per-packet case (price * bytes) stays in native 128-bit arithmetic
+    Money operator *(size_t count) const {
+        Value_ value;
+        orc_assert_(!__builtin_mul_overflow(value_, count, &value), "money overflow");
+        return Raw(value);
+    }
+
+    Money operator *(const uint256_t &count) const {
+        return Raw(Narrow(Wide(value_) * checked_int256_t(count)));
+    }
+
+    // value * numerator / denominator, without losing the intermediate product
+    Money Scale(const uint256_t &numerator, const uint256_t &denominator) const {
+        orc_assert(denominator != 0);
+        return Raw(Narrow(Wide(value_) * checked_int256_t(numerator) / checked_int256_t(denominator)));
+    }
+
+    // how many of unit this amount buys, with shift bits of fraction
+    checked_int256_t Divide(const Money &unit, unsigned shift = 0) const {
+        orc_assert(unit.value_ != 0);
+        return Wide(value_) * (checked_int256_t(1) << shift) / Wide(unit.value_);
+    }
+
+    bool operator ==(const Money &rhs) const {
+        return value_ == rhs.value_;
+    }
+
+    bool operator !=(const Money &rhs) const {
+        return value_ != rhs.value_;
+    }
+
+    bool operator <(const Money &rhs) const {
+        return value_ < rhs.value_;
+    }
+
+    bool operator <=(const Money &rhs) const {
+        return value_ <= rhs.value_;
+    }
+
+    bool operator >(const Money &rhs) const {
+        return value_ > rhs.value_;
+    }
+
+    bool operator >=(const Money &rhs) const {
+        return value_ >= rhs.value_;
+    }
+};
+
+}
+
+#endif//ORCHID_MONEY_HPP
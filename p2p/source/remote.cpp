@@ -78,6 +78,14 @@ class Reference {
         pbuf_ref(buffer_);
     }
 
+    // takes over a reference the caller already holds (such as from pbuf_alloc)
+    Reference(pbuf *buffer, bool owned) :
+        buffer_(buffer)
+    {
+        if (!owned)
+            pbuf_ref(buffer_);
+    }
+
     Reference(const Reference &other) = delete;
 
     Reference(Reference &&other) noexcept :
@@ -108,11 +116,13 @@ class Chain :
 
   public:
     Chain(const Buffer &data) :
-        buffer_(pbuf_alloc(PBUF_RAW, data.size(), PBUF_RAM))
+        buffer_(pbuf_alloc(PBUF_RAW, data.size(), PBUF_RAM), true)
     {
+        orc_assert(buffer_ != nullptr);
         u16_t offset(0);
         data.each([&](const uint8_t *data, size_t size) {
             orc_lwipcall(pbuf_take_at, (buffer_, data, size, offset));
+            copied_ += size;
             offset += size;
             return true;
         });
@@ -151,6 +161,33 @@ class Core {
     }
 };
 
+// a pbuf that borrows the memory of a Buffer rather than copying it; as that
+// memory is only ours until Land returns, lwIP must be done with it by then
+class Loan {
+  private:
+    pbuf_custom custom_;
+
+  public:
+    Loan(const uint8_t *data, size_t size) {
+        custom_.custom_free_function = [](pbuf *buffer) {};
+        orc_assert(pbuf_alloced_custom(PBUF_RAW, size, PBUF_REF, &custom_, const_cast<uint8_t *>(data), size) != nullptr);
+    }
+
+    Loan(const Loan &other) = delete;
+
+    ~Loan() {
+        orc_insist(custom_.pbuf.ref == 0);
+    }
+
+    operator pbuf *() {
+        return &custom_.pbuf;
+    }
+};
+
+// RemoteCommon hands datagrams on while lwIP holds the (non-recursive) core lock, on whichever thread called ip_input;
+// a Remote landed into from beneath that, such as the next hop of a chain, has to go through lwIP's own thread instead
+static thread_local unsigned receiving_(0);
+
 class RemoteCommon {
   protected:
     udp_pcb *pcb_;
@@ -174,11 +211,16 @@ class RemoteCommon {
         return pcb_;
     }
 
+    // this hands the data on before returning and never keeps the pbuf
+    static void Receive(void *arg, udp_pcb *pcb, pbuf *data, const ip4_addr_t *host, u16_t port) noexcept {
+        ++receiving_;
+        static_cast<RemoteCommon *>(arg)->Land(Chain(data), Socket(*host, port));
+        --receiving_;
+        pbuf_free(data);
+    }
+
     void Open(const Core &core) {
-        udp_recv(pcb_, [](void *arg, udp_pcb *pcb, pbuf *data, const ip4_addr_t *host, u16_t port) noexcept {
-            static_cast<RemoteCommon *>(arg)->Land(Chain(data), Socket(*host, port));
-            pbuf_free(data);
-        }, this);
+        udp_recv(pcb_, &Receive, this);
     }
 
     void Shut() noexcept {
@@ -271,16 +313,21 @@ class RemoteConnection final :
     cppcoro::async_mutex send_;
     cppcoro::async_manual_reset_event sent_;
 
+    // both only touched under Core; lwIP acknowledges bytes in order
+    uint64_t written_ = 0;
+    uint64_t acked_ = 0;
+
     cppcoro::async_auto_reset_event read_;
 
     struct Locked_ {
         std::exception_ptr error_;
-        std::queue<Beam> data_;
+        std::queue<Chain> data_;
         size_t offset_ = 0;
+        bool done_ = false;
     }; Locked<Locked_> locked_;
 
   protected:
-    void Land(const Buffer &data) {
+    void Land(pbuf *data) {
         locked_()->data_.emplace(data);
         read_.set();
     }
@@ -289,7 +336,7 @@ class RemoteConnection final :
         if (error != nullptr)
             locked_()->error_ = error;
         else
-            locked_()->data_.emplace(Beam());
+            locked_()->done_ = true;
         read_.set();
     }
 
@@ -309,42 +356,51 @@ class RemoteConnection final :
             tcp_abort(pcb_);
     }
 
+    // the pbufs lwIP handed us are read directly, and the window only opens
+    // back up as they are consumed (rather than as soon as they arrive)
     task<size_t> Read(Beam &buffer) override {
         auto data(buffer.data());
         auto size(buffer.size());
         orc_insist(size != 0);
 
         for (;; co_await read_, co_await Schedule()) {
-            const auto locked(locked_());
-            if (!locked->data_.empty()) {
-                size_t writ(0);
-
-              next:
-                const auto &next(locked->data_.front());
-                const auto base(next.data());
-                const auto rest(next.size() - locked->offset_);
-                if (rest == 0)
-                    co_return 0;
-
-                const auto have(std::min(size, rest));
-                Copy(data, base + locked->offset_, have);
-                writ += have;
-
-                if (rest != have)
-                    locked->offset_ += have;
-                else {
-                    locked->data_.pop();
-                    locked->offset_ = 0;
-                    if (size != have && !locked->data_.empty()) {
-                        data += have;
-                        size -= have;
-                        goto next;
+            size_t writ(0);
+
+            { const auto locked(locked_());
+                while (size != 0 && !locked->data_.empty()) {
+                    const auto &next(locked->data_.front());
+                    const auto rest(next.size() - locked->offset_);
+                    const auto have(pbuf_copy_partial(next, data, u16_t(std::min<size_t>(size, rest)), u16_t(locked->offset_)));
+                    copied_ += have;
+                    writ += have;
+                    data += have;
+                    size -= have;
+
+                    if (rest != have)
+                        locked->offset_ += have;
+                    else {
+                        locked->data_.pop();
+                        locked->offset_ = 0;
                     }
                 }
 
-                co_return writ;
-            } else if (locked->error_ != nullptr)
-                std::rethrow_exception(locked->error_);
+                if (writ == 0) {
+                    if (locked->done_)
+                        co_return 0;
+                    if (locked->error_ != nullptr)
+                        std::rethrow_exception(locked->error_);
+                    continue;
+                }
+            }
+
+            Core core;
+            if (pcb_ != nullptr)
+                for (auto rest(writ); rest != 0; ) {
+                    const auto some(std::min<size_t>(rest, 0xffff));
+                    tcp_recved(pcb_, u16_t(some));
+                    rest -= some;
+                }
+            co_return writ;
         }
     }
 
@@ -358,9 +414,7 @@ class RemoteConnection final :
                 if (data == nullptr)
                     self->Stop(nullptr);
                 else {
-                    const Chain chain(data);
-                    self->Land(chain);
-                    tcp_recved(pcb, chain.size());
+                    self->Land(data);
                     pbuf_free(data);
                 }
 
@@ -385,11 +439,11 @@ class RemoteConnection final :
                 }
             });
 
-            // XXX: I feel like I should be verifying that size covered the entire sent packet
             tcp_sent(pcb_, [](void *arg, tcp_pcb *pcb, u16_t size) noexcept -> err_t {
                 const auto self(static_cast<RemoteConnection *>(arg));
                 orc_insist(pcb == self->pcb_);
 
+                self->acked_ += size;
                 self->sent_.set();
                 return ERR_OK;
             });
@@ -415,48 +469,135 @@ class RemoteConnection final :
         orc_except({ orc_lwipcall(tcp_shutdown, (pcb_, false, true)); });
     }
 
+    // writes too large for the send buffer (which would have waited on acknowledgments anyway) are not
+    // copied into lwIP: the caller's buffer is instead pinned (by not returning) until all of it is acknowledged,
+    // and each segment is only copied as Remote::Send queues it for output
     task<void> Send(const Buffer &data) override {
-        const auto lock(co_await send_.scoped_lock_async());
-
         Window window(data);
         auto rest(window.size());
+        const bool pinned(rest > TCP_SND_BUF);
 
-        goto start; do {
-            co_await sent_;
-            co_await Schedule();
+        uint64_t end;
 
-          start:
-            Core core;
-            orc_assert(pcb_ != nullptr);
+        { const auto lock(co_await send_.scoped_lock_async());
+            const auto begin(written_);
+
+            try {
+                goto start; do {
+                    co_await sent_;
+                    co_await Schedule();
 
-            const auto need(tcp_sndbuf(pcb_));
-            if (need == 0) {
+                  start:
+                    Core core;
+                    orc_assert(pcb_ != nullptr);
+
+                    const auto need(tcp_sndbuf(pcb_));
+                    if (need == 0) {
+                        sent_.reset();
+                        continue;
+                    }
+
+                    window.Take(std::min<size_t>(rest, need), [&](const uint8_t *data, size_t size) {
+                        // tcp_write takes a u16_t, but with LWIP_WND_SCALE need can be larger
+                        if (size > 0xffff)
+                            size = 0xffff;
+                        rest -= size;
+
+                        u8_t flags(pinned ? 0 : TCP_WRITE_FLAG_COPY);
+                        if (rest != 0)
+                            flags |= TCP_WRITE_FLAG_MORE;
+                        orc_lwipcall(tcp_write, (pcb_, data, size, flags));
+                        if (!pinned)
+                            copied_ += size;
+                        written_ += size;
+                        return size;
+                    });
+                } while (rest != 0);
+
+                if (pinned) {
+                    Core core;
+                    orc_assert(pcb_ != nullptr);
+                    orc_lwipcall(tcp_output, (pcb_));
+                }
+            } catch (...) {
+                // lwIP may still reference the part already written, and the caller is about to take it back
+                if (pinned && written_ != begin) {
+                    Core core;
+                    if (pcb_ != nullptr) {
+                        tcp_abort(pcb_);
+                        pcb_ = nullptr;
+                    }
+                }
+
+                throw;
+            }
+
+            end = written_;
+        }
+
+        if (!pinned)
+            co_return;
+
+        // the next write can be queued while this one waits for its acknowledgment
+        for (;;) {
+            { Core core;
+                // if the connection failed, lwIP has already dropped the segments
+                orc_assert(pcb_ != nullptr);
+                if (acked_ >= end)
+                    break;
                 sent_.reset();
-                continue;
             }
 
-            window.Take(std::min<size_t>(rest, need), [&](const uint8_t *data, size_t size) {
-                // XXX: this can't actually happen as need is a uint16_t, but for type safety...
-                if (size > 0xffff)
-                    size = 0xffff;
-                rest -= size;
-
-                // XXX: consider avoiding copies by holding the buffer until send completes
-                u8_t flags(TCP_WRITE_FLAG_COPY);
-                if (rest != 0)
-                    flags |= TCP_WRITE_FLAG_MORE;
-                orc_lwipcall(tcp_write, (pcb_, data, size, flags));
-                copied_ += size;
-                return size;
-            });
-        } while (rest != 0);
+            co_await sent_;
+            co_await Schedule();
+        }
     }
 };
 
+// segments of a write made without TCP_WRITE_FLAG_COPY point into the writer's own buffer
+static bool Borrowed(const pbuf *buffer) {
+    for (; buffer != nullptr; buffer = buffer->next)
+        if ((buffer->type_internal & PBUF_TYPE_ALLOC_SRC_MASK) == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF)
+            return true;
+    return false;
+}
+
 void Remote::Send(pbuf *buffer) {
-    nest_.Hatch([&]() noexcept { return [this, data = Chain(buffer)]() -> task<void> {
-        co_return co_await Inner().Send(data);
-    }; });
+    // a pinned Send returns once its data is acknowledged, which can happen (for the original) while a
+    // retransmission of it is still queued here; so anything borrowed is copied before it is kept
+    if (!Borrowed(buffer))
+        pbuf_ref(buffer);
+    else if ((buffer = pbuf_clone(PBUF_RAW, PBUF_RAM, buffer)) == nullptr)
+        return;
+
+    { const auto locked(locked_());
+        locked->pending_.emplace_back(buffer);
+        if (locked->pending_.size() != 1)
+            return; }
+
+    if (!nest_.Hatch([&]() noexcept { return [this]() -> task<void> {
+        // the rest of this burst is still being output under the lock lwIP holds
+        co_await Schedule();
+
+        std::vector<pbuf *> pending;
+        std::swap(pending, locked_()->pending_);
+
+        std::vector<Chain> chains;
+        chains.reserve(pending.size());
+        std::vector<const Buffer *> data;
+        data.reserve(pending.size());
+        for (const auto buffer : pending) {
+            data.emplace_back(&chains.emplace_back(buffer));
+            pbuf_free(buffer);
+        }
+
+        co_await Inner().Pour(data);
+    }; })) {
+        const auto locked(locked_());
+        for (const auto buffer : locked->pending_)
+            pbuf_free(buffer);
+        locked->pending_.clear();
+    }
 }
 
 err_t Remote::Output(netif *interface, pbuf *buffer, const ip4_addr_t *destination) {
@@ -471,8 +612,76 @@ err_t Remote::Initialize(netif *interface) {
     return ERR_OK;
 }
 
+// an unfragmented UDP datagram, all of whose possible receivers are our own
+static bool Direct(const Core &core, const uint8_t *data, size_t size) {
+    if (size < 20 || (data[0] >> 4) != 4 || data[9] != IP_PROTO_UDP)
+        return false;
+    const size_t header((data[0] & 0xf) * 4);
+    if (header < 20 || size < header + 8)
+        return false;
+    if ((((data[6] << 8) | data[7]) & 0x3fff) != 0)
+        return false;
+
+    // lwIP's sockets (unlike RemoteCommon) queue the pbuf for another thread
+    const u16_t port((data[header + 2] << 8) | data[header + 3]);
+    for (auto pcb(udp_pcbs); pcb != nullptr; pcb = pcb->next)
+        if (pcb->local_port == port && pcb->recv != &RemoteCommon::Receive)
+            return false;
+    return true;
+}
+
+void Remote::Input(const Core &core, const Buffer &data) {
+    const uint8_t *base(nullptr);
+    size_t size(0);
+    const auto single(data.each([&](const uint8_t *data, size_t writ) {
+        if (base != nullptr)
+            return false;
+        base = data;
+        size = writ;
+        return true;
+    }));
+
+    // input takes over the reference, unless it fails
+    const auto input([&](pbuf *buffer) {
+        if (interface_.input(buffer, &interface_) != ERR_OK)
+            pbuf_free(buffer);
+    });
+
+    if (single && base != nullptr && Direct(core, base, size)) {
+        Loan loan(base, size);
+        input(loan);
+    } else {
+        const Chain chain(data);
+        pbuf_ref(chain);
+        input(chain);
+    }
+}
+
+void Remote::Queue(const Buffer &data) {
+    const Chain chain(data);
+    pbuf_ref(chain);
+    if (tcpip_inpkt(chain, &interface_, interface_.input) != ERR_OK)
+        pbuf_free(chain);
+}
+
 void Remote::Land(const Buffer &data) {
-    orc_ignore({ orc_assert(tcpip_inpkt(Chain(data), &interface_, interface_.input) == ERR_OK); });
+    if (receiving_ != 0)
+        return Queue(data);
+    Core core;
+    Input(core, data);
+}
+
+// the whole burst goes in under one acquisition of the core lock
+void Remote::Flood(const std::vector<const Buffer *> &data) {
+    if (receiving_ != 0) {
+        for (const auto item : data)
+            Queue(*item);
+        return;
+    }
+
+    Core core;
+    for (const auto item : data)
+        Input(core, *item);
 }
 
 void Remote::Stop(const std::string &error) noexcept {
@@ -25,12 +25,15 @@
 
 #include <lwip/netif.h>
 
+#include "locked.hpp"
 #include "nest.hpp"
 #include "origin.hpp"
 #include "socket.hpp"
 
 namespace orc {
 
+class Core;
+
 class Remote :
     public Origin,
     public BufferDrain,
@@ -42,12 +45,21 @@ class Remote :
 
     netif interface_;
 
+    // lwIP's output piles up here until the Hatch started by its first packet takes it; batches do not wait on each other
+    struct Locked_ {
+        std::vector<pbuf *> pending_;
+    }; Locked<Locked_> locked_;
+
+    void Input(const Core &core, const Buffer &data);
+    void Queue(const Buffer &data);
+
     void Send(pbuf *buffer);
     static err_t Output(netif *interface, pbuf *buffer, const ip4_addr_t *destination);
     static err_t Initialize(netif *interface);
 
   protected:
     void Land(const Buffer &data) override;
+    void Flood(const std::vector<const Buffer *> &data) override;
     void Stop(const std::string &error) noexcept override;
 
   private:
@@ -0,0 +1,405 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+// XXX: the NDK headers lag behind what io_uring needs
+#if defined(__linux__) && !defined(__ANDROID__)
+
+#include <algorithm>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ringfile.hpp"
+#include "syscall.hpp"
+
+namespace orc {
+
+static int Setup(unsigned entries, io_uring_params &params) {
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+    return syscall(__NR_io_uring_setup, entries, &params);
+}
+
+static int Enter(int ring, unsigned submit, unsigned complete, unsigned flags) {
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+    return syscall(__NR_io_uring_enter, ring, submit, complete, flags, nullptr, 0);
+}
+
+template <typename Type_>
+static Type_ *Offset(void *base, size_t offset) {
+    return reinterpret_cast<Type_ *>(reinterpret_cast<uint8_t *>(base) + offset);
+}
+
+bool RingFile::Supported() {
+    io_uring_params params = {};
+    const auto ring(Setup(2, params));
+    if (ring == -1)
+        return false;
+    close(ring);
+    return true;
+}
+
+RingFile::RingFile(BufferDrain &drain, int file, unsigned reads) :
+    Link<Buffer>(drain),
+    file_(file),
+    reads_(reads)
+{
+    orc_assert(file_ != -1);
+    orc_assert(reads_ != 0 && reads_ < Entries_);
+
+    io_uring_params params = {};
+    ring_ = orc_syscall(Setup(Entries_, params));
+
+    const auto map([&](size_t size, off_t offset) {
+        // NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+        const auto data(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, offset));
+        orc_assert(data != MAP_FAILED);
+        maps_.emplace_back(Map{data, size});
+        return data;
+    });
+
+    auto sq_size(params.sq_off.array + params.sq_entries * sizeof(unsigned));
+    auto cq_size(params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+        sq_size = cq_size = std::max(sq_size, cq_size);
+
+    const auto sq(map(sq_size, IORING_OFF_SQ_RING));
+    const auto cq((params.features & IORING_FEAT_SINGLE_MMAP) != 0 ? sq : map(cq_size, IORING_OFF_CQ_RING));
+    sqes_ = static_cast<io_uring_sqe *>(map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+
+    sq_head_ = Offset<unsigned>(sq, params.sq_off.head);
+    sq_tail_ = Offset<unsigned>(sq, params.sq_off.tail);
+    sq_mask_ = *Offset<unsigned>(sq, params.sq_off.ring_mask);
+    sq_entries_ = *Offset<unsigned>(sq, params.sq_off.ring_entries);
+    sq_array_ = Offset<unsigned>(sq, params.sq_off.array);
+
+    cq_head_ = Offset<unsigned>(cq, params.cq_off.head);
+    cq_tail_ = Offset<unsigned>(cq, params.cq_off.tail);
+    cq_mask_ = *Offset<unsigned>(cq, params.cq_off.ring_mask);
+    cqes_ = Offset<io_uring_cqe>(cq, params.cq_off.cqes);
+}
+
+RingFile::~RingFile() {
+    for (const auto &map : maps_)
+        munmap(map.data_, map.size_);
+    if (ring_ != -1)
+        close(ring_);
+}
+
+io_uring_sqe *RingFile::Entry(Locked_ &locked) {
+    const auto tail(*sq_tail_);
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+        return nullptr;
+    const auto index(tail & sq_mask_);
+    const auto entry(&sqes_[index]);
+    memset(entry, 0, sizeof(*entry));
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++locked.unsubmitted_;
+    return entry;
+}
+
+void RingFile::Submit(Locked_ &locked) {
+    if (locked.unsubmitted_ == 0)
+        return;
+    const auto submitted(orc_syscall(Enter(ring_, locked.unsubmitted_, 0, 0)));
+    orc_assert(submitted >= 0);
+    locked.unsubmitted_ -= std::min<unsigned>(submitted, locked.unsubmitted_);
+}
+
+// reads are tagged odd and writes by their (aligned, so even) Pending; zero is the wakeup from Shut,
+// and Ignored_ is anything whose completion does not matter (cancellations, or writes withdrawn unsent)
+static const uint64_t Ignored_ = 2;
+
+void RingFile::Read(Locked_ &locked, unsigned index) {
+    const auto entry(Entry(locked));
+    // reads_ < Entries_, and writes never take the last reads_ slots
+    orc_insist(entry != nullptr);
+    entry->fd = file_;
+    if (vectors_.empty()) {
+        entry->opcode = IORING_OP_READ_FIXED;
+        entry->addr = reinterpret_cast<uintptr_t>(buffers_.data() + index * size_);
+        entry->len = size_;
+        entry->buf_index = 0;
+    } else {
+        entry->opcode = IORING_OP_READV;
+        entry->addr = reinterpret_cast<uintptr_t>(&vectors_[index]);
+        entry->len = 1;
+    }
+    entry->user_data = index * 2 + 1;
+    reading_[index] = true;
+}
+
+void RingFile::Flush(Locked_ &locked) {
+    while (!locked.pending_.empty() && locked.flight_.size() + reads_ < sq_entries_) {
+        const auto entry(Entry(locked));
+        if (entry == nullptr)
+            break;
+        const auto pending(locked.pending_.front());
+        locked.pending_.pop_front();
+        locked.flight_.emplace(pending);
+        pending->position_ = *sq_tail_ - 1;
+
+        entry->opcode = IORING_OP_WRITEV;
+        entry->fd = file_;
+        entry->addr = reinterpret_cast<uintptr_t>(pending->vectors_.data());
+        entry->len = pending->vectors_.size();
+        entry->user_data = reinterpret_cast<uintptr_t>(pending);
+    }
+
+    Submit(locked);
+}
+
+// if the kernel has not taken a write yet it can still be forgotten (its entry, if any, becomes a NOP)
+bool RingFile::Withdraw(Locked_ &locked, Pending *pending) {
+    const auto queued(std::find(locked.pending_.begin(), locked.pending_.end(), pending));
+    if (queued != locked.pending_.end()) {
+        locked.pending_.erase(queued);
+        return true;
+    }
+
+    if (locked.flight_.find(pending) == locked.flight_.end())
+        return true;
+    if (int(pending->position_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)) < 0)
+        return false;
+
+    auto &entry(sqes_[pending->position_ & sq_mask_]);
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_NOP;
+    entry.user_data = Ignored_;
+    locked.flight_.erase(pending);
+    return true;
+}
+
+void RingFile::Wrote(Pending *pending, int result) {
+    { const auto locked(locked_());
+        locked->flight_.erase(pending); }
+    pending->result_ = result;
+    pending->sent_();
+}
+
+void RingFile::Cancel(Locked_ &locked, uint64_t target) {
+    auto entry(Entry(locked));
+    if (entry == nullptr) {
+        orc_except({ Submit(locked); });
+        entry = Entry(locked);
+        // without room for the cancellation, whatever it was for will have to complete on its own
+        if (entry == nullptr)
+            return;
+    }
+
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = target;
+    entry->user_data = Ignored_;
+}
+
+void RingFile::Close(const std::string &error) noexcept {
+    { const auto locked(locked_());
+        locked->closed_ = true;
+        // the kernel never saw these
+        for (const auto pending : locked->pending_) {
+            pending->result_ = -ECANCELED;
+            pending->sent_();
+        }
+        locked->pending_.clear();
+
+        // the rest still reference their writers' buffers (or ours), so they have to actually complete (or be cancelled)
+        for (const auto pending : locked->flight_)
+            Cancel(*locked, reinterpret_cast<uintptr_t>(pending));
+        for (unsigned index(0); index != reads_; ++index)
+            if (reading_[index])
+                Cancel(*locked, index * 2 + 1);
+        orc_except({ Submit(*locked); }); }
+
+    for (;;) {
+        if (locked_()->flight_.empty() && std::find(reading_.begin(), reading_.end(), true) == reading_.end())
+            break;
+
+        // without a working ring there is no way to know when the kernel is done with them
+        orc_insist(!orc_ignore({ orc_syscall(Enter(ring_, 0, 1, IORING_ENTER_GETEVENTS)); }));
+
+        auto head(*cq_head_);
+        const auto tail(__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE));
+        for (; head != tail; ++head) {
+            const auto &completion(cqes_[head & cq_mask_]);
+            if (completion.user_data == 0 || completion.user_data == Ignored_) {
+            } else if ((completion.user_data & 1) == 0)
+                Wrote(reinterpret_cast<Pending *>(completion.user_data), completion.res);
+            else
+                reading_[completion.user_data / 2] = false;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    { const auto locked(locked_());
+        close(ring_);
+        ring_ = -1;
+        close(file_); }
+
+    Link::Stop(error);
+}
+
+void RingFile::Open(size_t size, size_t batch) {
+    orc_assert(batch != 0);
+    size_ = size;
+    buffers_ = Beam(reads_ * size_);
+
+    iovec vector{buffers_.data(), buffers_.size()};
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+    if (syscall(__NR_io_uring_register, ring_, IORING_REGISTER_BUFFERS, &vector, 1) == -1) {
+        // registration counts against RLIMIT_MEMLOCK (and can be filtered on its own); plain reads still work
+        for (unsigned i(0); i != reads_; ++i)
+            vectors_.push_back({buffers_.data() + i * size_, size_});
+    }
+
+    reading_.assign(reads_, false);
+    { const auto locked(locked_());
+        for (unsigned i(0); i != reads_; ++i)
+            Read(*locked, i);
+        Submit(*locked); }
+
+    std::thread([this, batch]() {
+        std::string error;
+        std::vector<Subset> subsets;
+        std::vector<const Buffer *> flood;
+
+        for (bool shut(false); !shut; ) {
+            try {
+                orc_syscall(Enter(ring_, 0, 1, IORING_ENTER_GETEVENTS));
+            } catch (const Error &failure) {
+                error = failure.what_;
+                break;
+            }
+
+            std::vector<unsigned> reads;
+            subsets.clear();
+
+            auto head(*cq_head_);
+            const auto tail(__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE));
+            for (; head != tail; ++head) {
+                const auto &completion(cqes_[head & cq_mask_]);
+                const auto result(completion.res);
+                if ((completion.user_data & 1) != 0)
+                    reading_[completion.user_data / 2] = false;
+
+                if (completion.user_data == 0)
+                    shut = true;
+                else if (completion.user_data == Ignored_) {
+                } else if ((completion.user_data & 1) == 0)
+                    Wrote(reinterpret_cast<Pending *>(completion.user_data), result);
+                else if (result == 0 || result == -ECANCELED)
+                    shut = true;
+                else if (result < 0) {
+                    error = strerror(-result);
+                    shut = true;
+                } else {
+                    const unsigned index(completion.user_data / 2);
+                    subsets.emplace_back(buffers_.subset(index * size_, result));
+                    if (Verbose)
+                        Log() << "\e[33mRECV " << result << " " << subsets.back() << "\e[0m" << std::endl;
+                    reads.emplace_back(index);
+                }
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+            // the buffers are only handed back to the kernel below, after everything has landed
+            for (size_t offset(0); offset < subsets.size(); offset += batch) {
+                const auto count(std::min(batch, subsets.size() - offset));
+                if (count == 1) {
+                    Link::Land(subsets[offset]);
+                    continue;
+                }
+                flood.clear();
+                for (size_t i(0); i != count; ++i)
+                    flood.emplace_back(&subsets[offset + i]);
+                Faucet<BufferDrain>::Outer().Flood(flood);
+            }
+
+            if (shut)
+                break;
+
+            try {
+                const auto locked(locked_());
+                for (const auto index : reads)
+                    Read(*locked, index);
+                // writes that found the queue full were left for us
+                Flush(*locked);
+            } catch (const Error &failure) {
+                error = failure.what_;
+                break;
+            }
+        }
+
+        Close(error);
+    }).detach();
+}
+
+task<void> RingFile::Shut() noexcept {
+    { const auto locked(locked_());
+        if (!locked->closed_) {
+            const auto entry(Entry(*locked));
+            orc_insist(entry != nullptr);
+            entry->opcode = IORING_OP_NOP;
+            entry->user_data = 0;
+            orc_except({ Submit(*locked); });
+        } }
+
+    co_await Link::Shut();
+}
+
+task<void> RingFile::Send(const Buffer &data) {
+    if (Verbose)
+        Log() << "\e[35mSEND " << data.size() << " " << data << "\e[0m" << std::endl;
+
+    Pending pending{data};
+    data.each([&](const uint8_t *data, size_t size) {
+        // NOLINTNEXTLINE (cppcoreguidelines-pro-type-const-cast)
+        pending.vectors_.push_back({const_cast<uint8_t *>(data), size});
+        return true;
+    });
+
+    std::exception_ptr error;
+
+    { const auto locked(locked_());
+        orc_assert(!locked->closed_);
+        locked->pending_.emplace_back(&pending);
+        // everything queued by now goes in this one io_uring_enter
+        try {
+            Flush(*locked);
+        } catch (...) {
+            error = std::current_exception();
+            if (Withdraw(*locked, &pending))
+                std::rethrow_exception(error);
+        } }
+
+    // if the kernel took it anyway, the buffer stays ours until it completes
+    co_await *pending.sent_;
+    if (error != nullptr)
+        std::rethrow_exception(error);
+    const auto writ(pending.result_);
+    orc_assert_(writ == int(data.size()), "orc_assert(" << writ << " {writ} == " << data.size() << " {data.size()})");
+}
+
+}
+
+#endif
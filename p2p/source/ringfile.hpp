@@ -0,0 +1,119 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_RINGFILE_HPP
+#define ORCHID_RINGFILE_HPP
+
+#include <deque>
+#include <unordered_set>
+
+#include <linux/io_uring.h>
+
+#include "event.hpp"
+#include "link.hpp"
+#include "locked.hpp"
+
+namespace orc {
+
+// SyncFile, but over io_uring: a fixed set of reads into registered buffers is kept in flight, and
+// writes that pile up while one is being submitted go to the kernel together in one io_uring_enter
+class RingFile final :
+    public Link<Buffer>
+{
+  private:
+    static const unsigned Entries_ = 256;
+
+    const int file_;
+    const unsigned reads_;
+    int ring_;
+
+    struct Map {
+        void *data_;
+        size_t size_;
+    };
+
+    std::vector<Map> maps_;
+
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *sq_array_;
+    io_uring_sqe *sqes_;
+
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe *cqes_;
+
+    size_t size_ = 0;
+    Beam buffers_;
+    // empty if the buffers are registered; otherwise (such as when over RLIMIT_MEMLOCK) one per read
+    std::vector<iovec> vectors_;
+    // which reads the kernel might still write into buffers_ for; only the thread reaping completions touches this
+    std::vector<bool> reading_;
+
+    // a writer parks one of these (and keeps its own buffer) until its completion arrives
+    struct Pending {
+        const Buffer &data_;
+        std::vector<iovec> vectors_;
+        // where Flush put it in the submission ring
+        unsigned position_ = 0;
+        int result_ = 0;
+        Event sent_;
+    };
+
+    struct Locked_ {
+        bool closed_ = false;
+        unsigned unsubmitted_ = 0;
+        std::deque<Pending *> pending_;
+        std::unordered_set<Pending *> flight_;
+    }; Locked<Locked_> locked_;
+
+    io_uring_sqe *Entry(Locked_ &locked);
+    void Submit(Locked_ &locked);
+
+    void Read(Locked_ &locked, unsigned index);
+    void Flush(Locked_ &locked);
+    bool Withdraw(Locked_ &locked, Pending *pending);
+    void Cancel(Locked_ &locked, uint64_t target);
+    void Wrote(Pending *pending, int result);
+
+    void Close(const std::string &error) noexcept;
+
+  public:
+    // probes whether this kernel (and whatever seccomp policy we run under) allows io_uring at all
+    static bool Supported();
+
+    RingFile(BufferDrain &drain, int file, unsigned reads = 32);
+    ~RingFile() override;
+
+    // batch caps how many of the reads completed together are flooded at once
+    void Open(size_t size = 2048, size_t batch = 1);
+
+    task<void> Shut() noexcept override;
+    task<void> Send(const Buffer &data) override;
+};
+
+}
+
+#endif//ORCHID_RINGFILE_HPP
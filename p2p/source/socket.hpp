@@ -380,4 +380,33 @@ inline std::ostream &operator <<(std::ostream &out, const Three &three) {
 
 }
 
+namespace std {
+
+template <>
+struct hash<orc::Host> {
+    size_t operator ()(const orc::Host &value) const noexcept {
+        const in6_addr address(value);
+        uint64_t high, low;
+        memcpy(&high, address.s6_addr, sizeof(high));
+        memcpy(&low, address.s6_addr + sizeof(high), sizeof(low));
+        return (high * 0x9e3779b97f4a7c15 ^ low) * 0x9e3779b97f4a7c15 >> 16;
+    }
+};
+
+template <>
+struct hash<orc::Socket> {
+    size_t operator ()(const orc::Socket &value) const noexcept {
+        return hash<orc::Host>()(value.Host()) ^ size_t(value.Port()) * 0x9e3779b97f4a7c15;
+    }
+};
+
+template <>
+struct hash<orc::Three> {
+    size_t operator ()(const orc::Three &value) const noexcept {
+        return hash<orc::Socket>()(value) ^ value.Protocol();
+    }
+};
+
+}
+
 #endif//ORCHID_SOCKET_HPP
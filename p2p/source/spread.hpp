@@ -0,0 +1,114 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SPREAD_HPP
+#define ORCHID_SPREAD_HPP
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "buffer.hpp"
+#include "link.hpp"
+
+namespace orc {
+
+// one device opened several times (as with IFF_MULTI_QUEUE): every queue has its own reader, and
+// sends are spread by address pair so the packets of any one flow stay in order on one queue
+// File_ is anything that reads on its own once opened, such as SyncFile or RingFile
+template <typename File_>
+class Spread final :
+    public Link<Buffer>
+{
+  private:
+    std::vector<U<File_>> queues_;
+    // bytes ahead of the IP header on everything sent, such as a virtio_net_hdr
+    const size_t offset_;
+    std::atomic<bool> stopped_ = false;
+
+    size_t Pick(const Buffer &data) const {
+        if (queues_.size() == 1)
+            return 0;
+
+        Window window(data);
+        if (window.size() < offset_ + 20)
+            return 0;
+        window.Skip(offset_);
+        uint8_t header[20];
+        window.Take(header, sizeof(header));
+        if ((header[0] >> 4) != 4)
+            return 0;
+
+        uint32_t source, destination;
+        memcpy(&source, header + 12, sizeof(source));
+        memcpy(&destination, header + 16, sizeof(destination));
+        // symmetric, so both directions of a flow agree
+        return ((uint64_t(source ^ destination) * 0x9e3779b97f4a7c15) >> 32) % queues_.size();
+    }
+
+  protected:
+    void Flood(const std::vector<const Buffer *> &data) override {
+        return Faucet<BufferDrain>::Outer().Flood(data);
+    }
+
+    void Stop(const std::string &error) noexcept override {
+        if (!stopped_.exchange(true))
+            Link::Stop(error);
+    }
+
+  public:
+    Spread(BufferDrain &drain, size_t offset = 0) :
+        Link<Buffer>(drain),
+        offset_(offset)
+    {
+    }
+
+    template <typename... Args_>
+    File_ &Add(Args_ &&...args) {
+        queues_.emplace_back(std::make_unique<File_>(*this, std::forward<Args_>(args)...));
+        return *queues_.back();
+    }
+
+    size_t size() const {
+        return queues_.size();
+    }
+
+    void Open(size_t size = 2048, size_t batch = 1) {
+        orc_assert(!queues_.empty());
+        for (const auto &queue : queues_)
+            queue->Open(size, batch);
+    }
+
+    task<void> Shut() noexcept override {
+        for (const auto &queue : queues_)
+            co_await queue->Shut();
+        co_await Link::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        co_return co_await queues_[Pick(data)]->Send(data);
+    }
+};
+
+}
+
+#endif//ORCHID_SPREAD_HPP
@@ -23,6 +23,9 @@
 #ifndef ORCHID_SYNCFILE_HPP
 #define ORCHID_SYNCFILE_HPP
 
+#include <optional>
+#include <thread>
+
 #include <asio/ip/tcp.hpp>
 #include <asio/ip/udp.hpp>
 
@@ -52,44 +55,99 @@ class SyncFile final :
         return &sync_;
     }
 
-    size_t Read(Beam &beam) {
+    // 0 is the end of the file; nullopt is nothing more to read without blocking
+    std::optional<size_t> Read(uint8_t *data, size_t size) {
         size_t writ;
         try {
-            writ = sync_.read_some(asio::buffer(beam.data(), beam.size()));
+            writ = sync_.read_some(asio::buffer(data, size));
         } catch (const asio::system_error &error) {
             const auto code(error.code());
             if (code == asio::error::eof)
                 return 0;
+            if (code == asio::error::would_block)
+                return std::nullopt;
             orc_adapt(error);
         }
 
         if (Verbose)
-            Log() << "\e[33mRECV " << writ << " " << beam.subset(0, writ) << "\e[0m" << std::endl;
+            Log() << "\e[33mRECV " << writ << " " << Subset(data, writ) << "\e[0m" << std::endl;
         return writ;
     }
 
-    void Open() {
-        std::thread([this]() {
-            Beam beam(2048);
-            for (;;) {
-                size_t writ;
+    template <typename Wait_>
+    void Wait(Wait_ wait) {
+        try {
+            sync_.wait(wait);
+        } catch (const asio::system_error &error) {
+            orc_adapt(error);
+        }
+    }
+
+    void Write(const Buffer &data) {
+        if (Verbose)
+            Log() << "\e[35mSEND " << data.size() << " " << data << "\e[0m" << std::endl;
+
+        size_t writ;
+        for (;;) {
+            try {
+                writ = sync_.write_some(Sequence(data));
+                break;
+            } catch (const asio::system_error &error) {
+                if (error.code() != asio::error::would_block)
+                    orc_adapt(error);
+            }
+            Wait(Sync_::wait_write);
+        }
+
+        orc_assert_(writ == data.size(), "orc_assert(" << writ << " {writ} == " << data.size() << " {data.size()})");
+    }
+
+    // size is the largest single read: bigger than the MTU only for devices that hand over super-packets
+    // batch above 1 reads without blocking until nothing is left (or batch is reached) and floods all of it at once
+    void Open(size_t size = 2048, size_t batch = 1) {
+        orc_assert(batch != 0);
+        if (batch != 1)
+            sync_.non_blocking(true);
+
+        std::thread([this, size, batch]() {
+            Beam beam(size * batch);
+            std::vector<Subset> subsets;
+            std::vector<const Buffer *> flood;
+
+            for (bool end(false); !end; ) {
+                subsets.clear();
                 try {
-                    writ = Read(beam);
+                    while (subsets.size() != batch) {
+                        const auto data(beam.data() + subsets.size() * size);
+                        const auto writ(Read(data, size));
+                        if (!writ) {
+                            if (!subsets.empty())
+                                break;
+                            Wait(Sync_::wait_read);
+                        } else if (*writ == 0) {
+                            end = true;
+                            break;
+                        } else
+                            subsets.emplace_back(data, *writ);
+                    }
                 } catch (const Error &error) {
                     const auto &what(error.what_);
                     orc_insist(!what.empty());
                     Link::Stop(what);
-                    break;
+                    return;
                 }
 
-                if (writ == 0) {
-                    Link::Stop();
-                    break;
+                if (subsets.size() == 1)
+                    Link::Land(subsets[0]);
+                else if (!subsets.empty()) {
+                    flood.clear();
+                    for (const auto &subset : subsets)
+                        flood.emplace_back(&subset);
+                    Faucet<BufferDrain>::Outer().Flood(flood);
                 }
-
-                auto subset(beam.subset(0, writ));
-                Link::Land(subset);
             }
+
+            Link::Stop();
         }).detach();
     }
 
@@ -99,17 +157,14 @@ class SyncFile final :
     }
 
     task<void> Send(const Buffer &data) override {
-        if (Verbose)
-            Log() << "\e[35mSEND " << data.size() << " " << data << "\e[0m" << std::endl;
-
-        size_t writ;
-        try {
-            writ = sync_.write_some(Sequence(data));
-        } catch (const asio::system_error &error) {
-            orc_adapt(error);
-        }
-        orc_assert_(writ == data.size(), "orc_assert(" << writ << " {writ} == " << data.size() << " {data.size()})");
+        Write(data);
+        co_return;
+    }
 
+    // a TUN takes exactly one packet per write, so this is fewer hops rather than fewer system calls
+    task<void> Pour(const std::vector<const Buffer *> &data) override {
+        for (const auto item : data)
+            Write(*item);
         co_return;
     }
 };
@@ -23,21 +23,27 @@
 #ifndef ORCHID_UPDATER_HPP
 #define ORCHID_UPDATER_HPP
 
+#include <optional>
+
 #include "sleep.hpp"
 #include "updated.hpp"
 #include "valve.hpp"
 
 namespace orc {
 
+template <typename Code_>
+using Updated_ = typename decltype(std::declval<Code_>()())::Value;
+
 template <typename Code_>
 class Updater :
-    public Updated<typename decltype(std::declval<Code_>()())::Value>,
+    public Updated<Updated_<Code_>>,
     public Valve
 {
   private:
     unsigned milliseconds_;
     Code_ code_;
 
+    const bool warm_;
     Event ready_;
 
     task<void> Update() {
@@ -46,10 +52,14 @@ class Updater :
     }
 
   public:
-    Updater(unsigned milliseconds, Code_ &&code) :
+    Updater(unsigned milliseconds, Code_ &&code, std::optional<Updated_<Code_>> value = std::nullopt) :
         milliseconds_(milliseconds),
-        code_(std::move(code))
+        code_(std::move(code)),
+        warm_(value.has_value())
     {
+        if (warm_)
+            std::swap(*this->value_(), *value);
+
         Spawn([this]() noexcept -> Task<void> {
             co_await ready_([this]() -> task<void> {
                 co_await Update();
@@ -65,7 +75,9 @@ class Updater :
     }
 
     Task<void> Open() override {
-        co_await *ready_;
+        // a warm value is served until the first update replaces it
+        if (!warm_)
+            co_await *ready_;
     }
 
     Task<void> Shut() noexcept override {
@@ -74,8 +86,8 @@ class Updater :
 };
 
 template <typename Code_>
-S<Updater<Code_>> Update(unsigned milliseconds, Code_ &&code) {
-    return Break<Updater<Code_>>(milliseconds, std::forward<Code_>(code));
+S<Updater<Code_>> Update(unsigned milliseconds, Code_ &&code, std::optional<Updated_<Code_>> value = std::nullopt) {
+    return Break<Updater<Code_>>(milliseconds, std::forward<Code_>(code), std::move(value));
 }
 
 }
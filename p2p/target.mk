@@ -79,6 +79,11 @@ endif
 
 cflags += -I$(pwd)/lwip/src/include
 
+# make lwip=throughput for servers and desktops (see extra/lwipopts.h)
+ifeq ($(lwip),throughput)
+cflags += -DORC_LWIP_THROUGHPUT
+endif
+
 cflags += -DLWIP_ERRNO_STDINCLUDE
 
 
@@ -0,0 +1,53 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_BUCKET_HPP
+#define ORCHID_BUCKET_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace orc {
+
+// a token bucket holding at most one second's worth of rate, refilled by whole seconds (as Egress::Now counts them)
+class Bucket {
+  private:
+    // starts full: the first call clamps it to one second's worth
+    uint32_t tokens_ = std::numeric_limits<uint32_t>::max();
+    uint32_t refilled_ = 0;
+
+  public:
+    bool operator ()(uint32_t rate, uint32_t now) {
+        tokens_ = uint32_t(std::min<uint64_t>(rate, tokens_ + uint64_t(now - refilled_) * rate));
+        refilled_ = now;
+
+        if (tokens_ == 0)
+            return false;
+
+        --tokens_;
+        return true;
+    }
+};
+
+}
+
+#endif//ORCHID_BUCKET_HPP
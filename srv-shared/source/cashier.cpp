@@ -20,24 +20,25 @@
 /* }}} */
 
 
-#include <boost/multiprecision/cpp_bin_float.hpp>
+#include <algorithm>
 
 #include "baton.hpp"
 #include "cashier.hpp"
 #include "duplex.hpp"
 #include "json.hpp"
+#include "log.hpp"
 #include "parallel.hpp"
 #include "sleep.hpp"
 #include "structured.hpp"
 
 namespace orc {
 
-static const Float Two128(uint256_t(1) << 128);
-//static const Float Two30(1024 * 1024 * 1024);
-
 static const auto Update_(Hash("Update(address,address,uint128,uint128,uint256)"));
 static const auto Bound_(Hash("Update(address,address)"));
 
+// as close to process start as this file can get, for reporting the time to the first accepted ticket
+static const auto Boot_(std::chrono::steady_clock::now());
+
 task<void> Cashier::Look(const Address &signer, const Address &funder, const std::string &combined) {
     static const auto look(Hash("look(address,address)").Clip<4>().num<uint32_t>());
     Builder builder;
@@ -62,29 +63,21 @@ void Cashier::Land(Json::Value data) {
 
         if (false) {
         } else if (event == Update_) {
-#if 0
-            const uint128_t subscription(params["subscription"].asString());
-
-            const auto pot([&]() {
-                const auto cache(cache_());
-                const auto identity(cache->subscriptions_.find(subscription));
-                orc_assert(identity != cache->subscriptions_.end());
-                const auto pot(cache->pots_.find(identity->second));
-                orc_assert(pot != cache->pots_.end());
-                return pot->second;
-            }());
-#else
             const Number<uint256_t> funder(topics[1].asString());
             const Number<uint256_t> signer(topics[2].asString());
             const Identity identity{signer.num<uint256_t>(), funder.num<uint256_t>()};
 
-            const auto pot([&]() {
+            const auto pot([&]() -> S<Pot> {
                 const auto cache(cache_());
-                const auto pot(cache->pots_.find(identity));
-                orc_assert(pot != cache->pots_.end());
-                return pot->second;
+                const auto entry(cache->pots_.Find(identity));
+                if (entry == nullptr)
+                    return nullptr;
+                return entry->pot_;
             }());
-#endif
+
+            // the pot was evicted and its unsubscribe is still in flight
+            if (pot == nullptr)
+                return;
 
             const auto data(Bless(result["data"].asString()));
             Window window(data);
@@ -96,6 +89,7 @@ void Cashier::Land(Json::Value data) {
                 locked->amount_ = amount;
                 locked->escrow_ = escrow;
                 locked->unlock_ = unlock;
+                snapshot_->Push(identity, *locked);
             }
 
             (*pot)();
@@ -104,11 +98,30 @@ void Cashier::Land(Json::Value data) {
         } else orc_throw("unknown message " << data);
     } else {
         const auto value(id.asString());
+        if (value == "M") {
+            ++cache_()->subscriptions_;
+            return;
+        }
+
         const auto [identity] = Take<Identity>(Bless(value.substr(1)));
         const auto result(data["result"].asString());
         switch (value[0]) {
             case 'S': {
-                orc_assert(cache_()->subscriptions_.emplace(result, identity).second);
+                const auto stale([&, &identity = identity]() {
+                    const auto cache(cache_());
+                    const auto entry(cache->pots_.Find(identity));
+                    if (entry == nullptr || !entry->subscription_.empty())
+                        return true;
+                    entry->subscription_ = result;
+                    ++cache->subscriptions_;
+                    return false;
+                }());
+
+                // the pot was evicted (or replaced) before the node confirmed the subscription
+                if (stale)
+                    Spawn([this, identity = identity, result]() noexcept -> task<void> {
+                        orc_ignore({ co_await Unsubscribe(identity, result); });
+                    });
             } break;
 
             case 'C': {
@@ -117,23 +130,32 @@ void Cashier::Land(Json::Value data) {
                 const auto [amount, escrow, unlock, verify, codehash, shared] = Coded<std::tuple<uint128_t, uint128_t, uint256_t, Address, Bytes32, Bytes>>::Decode(window);
                 window.Stop();
 
-                const auto pot([this, &identity = identity]() {
+                const auto pot([this, &identity = identity]() -> S<Pot> {
                     const auto cache(cache_());
-                    const auto pot(cache->pots_.find(identity));
-                    orc_assert(pot != cache->pots_.end());
-                    return pot->second;
+                    const auto entry(cache->pots_.Find(identity));
+                    if (entry == nullptr)
+                        return nullptr;
+                    return entry->pot_;
                 }());
 
+                // a warm pot (which nobody is waiting on) can be evicted while it is being looked up again
+                if (pot == nullptr)
+                    break;
+
                 {
                     const auto locked(pot->locked_());
                     locked->amount_ = amount;
                     locked->escrow_ = escrow;
                     locked->unlock_ = unlock;
+                    snapshot_->Push(identity, *locked);
                 }
 
                 (*pot)();
             } break;
 
+            case 'U':
+                break;
+
             default:
                 orc_assert(false);
         }
@@ -145,21 +167,34 @@ void Cashier::Stop(const std::string &error) noexcept {
     Valve::Stop();
 }
 
-Cashier::Cashier(Endpoint endpoint, S<Updated<Fiat>> fiat, S<Gauge> gauge, const Float &price, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient) :
-    endpoint_(std::move(endpoint)),
+Cashier::Cashier(S<Spool> spool, S<Snapshot> snapshot, S<Updated<Fiat>> fiat, S<Gauge> gauge, const Money &price, const Address &lottery, const uint256_t &chain, const Address &recipient, bool multiplex, size_t maximum, unsigned idle) :
+    spool_(std::move(spool)),
+    snapshot_(std::move(snapshot)),
     fiat_(std::move(fiat)),
     gauge_(std::move(gauge)),
 
     price_(price),
 
-    personal_(personal),
-    password_(std::move(password)),
-
     lottery_(lottery),
     chain_(chain),
-    recipient_(recipient)
+    recipient_(recipient),
+
+    multiplex_(multiplex),
+    maximum_(std::max<size_t>(maximum, 1)),
+    idle_(std::chrono::seconds(idle))
 {
     type_ = typeid(*this).name();
+
+    // warm pots can be billed against immediately; the first Check on each one revalidates it in the background
+    const auto cache(cache_());
+    const auto now(std::chrono::steady_clock::now());
+    for (const auto &[identity, balance] : snapshot_->Pots(maximum_)) {
+        auto &entry(cache->pots_.Append(identity, now));
+        entry.pot_ = Make<Pot>();
+        *entry.pot_->locked_() = balance;
+        (*entry.pot_)();
+        entry.warm_ = true;
+    }
 }
 
 void Cashier::Open(S<Origin> origin, Locator locator) {
@@ -172,6 +207,15 @@ void Cashier::Open(S<Origin> origin, Locator locator) {
         auto &inverted(structured.Wire<Inverted>(std::move(duplex)));
         inverted.Open();
         station_ = std::move(station);
+
+        // one filter over the whole lottery; Land decodes each log once and routes it by (signer, funder)
+        if (multiplex_)
+            co_await station_->Send("eth_subscribe", "M", {"logs", Map{
+                {"address", lottery_},
+                {"topics", {{Update_, Bound_}}},
+            }});
+
+        watching_();
     }());
 }
 
@@ -181,69 +225,127 @@ task<void> Cashier::Shut() noexcept {
     co_await Valve::Shut();
 }
 
-Float Cashier::Bill(size_t size) const {
+Money Cashier::Bill(size_t size) const {
     return price_ * size;
 }
 
-checked_int256_t Cashier::Convert(const Float &balance) const {
-    const auto oxt((*fiat_)().oxt_);
-    return checked_int256_t(balance / oxt * Two128);
+Cashier::Table_::Table_(S<Gauge::Prices_> prices, Fiat fiat) :
+    prices_(std::move(prices)),
+    fiat_(std::move(fiat)),
+    rates_(*prices_, fiat_)
+{
 }
 
-std::pair<Float, uint256_t> Cashier::Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const {
-    const auto fiat((*fiat_)());
+S<const Cashier::Table_> Cashier::Table() const {
+    auto prices(gauge_->Prices());
+    auto fiat((*fiat_)());
 
-    const auto base(Float(amount) * fiat.oxt_);
-    const auto until(start + range);
+    if (auto table = std::atomic_load(&table_))
+        if (table->prices_ == prices && table->fiat_.eth_ == fiat.eth_ && table->fiat_.oxt_ == fiat.oxt_)
+            return table;
 
-    std::pair<Float, uint256_t> credit(0, 10*Gwei);
+    snapshot_->Push(fiat);
+    snapshot_->Push(prices);
 
-    const auto prices(gauge_->Prices());
-    for (const auto &[price, time] : *prices) {
-        const auto when(now + unsigned(time));
-        if (when >= until) continue;
-        const auto cost(price * Gwei / 10);
-        const auto profit((start < when ? base * Float(range - (when - start)) / Float(range) : base) - Float(gas * cost) * fiat.eth_);
-        if (profit > std::get<0>(credit))
-            credit = {profit, cost};
-    }
+    // racing rebuilds might store an older table last, but the next call compares it against the current inputs and replaces it
+    S<const Table_> table(Make<Table_>(std::move(prices), std::move(fiat)));
+    std::atomic_store(&table_, table);
+    return table;
+}
+
+checked_int256_t Cashier::Convert(const Money &balance) const {
+    return balance.Divide(Table()->rates_.oxt_, 128);
+}
 
-    return credit;
+std::pair<Money, uint256_t> Cashier::Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const {
+    return Table()->rates_.Credit(now, start, range, amount, gas);
+}
+
+void Cashier::Evict(const Lock<Cache_> &cache, std::chrono::steady_clock::time_point now, std::vector<std::pair<Identity, std::string>> &subscriptions) {
+    cache->pots_.Evict(maximum_, idle_, now, [&](const Identity &identity, Entry_ &entry) {
+        // a pot nobody has heard about yet has a Check waiting on it
+        if (!*entry.pot_)
+            return false;
+
+        if (!entry.subscription_.empty()) {
+            subscriptions.emplace_back(identity, std::move(entry.subscription_));
+            --cache->subscriptions_;
+        }
+
+        ++cache->evictions_;
+        return true;
+    });
+}
+
+task<void> Cashier::Unsubscribe(const Identity &identity, const std::string &subscription) {
+    co_await station_->Send("eth_unsubscribe", 'U' + Combine(std::get<0>(identity), std::get<1>(identity)), {subscription});
 }
 
 task<bool> Cashier::Check(const Address &signer, const Address &funder, const uint128_t &amount, const Address &recipient, const Buffer &receipt) {
+    std::vector<std::pair<Identity, std::string>> evicted;
+
     const auto [pot, subscribe] = [&]() -> std::tuple<S<Pot>, bool> {
         const auto cache(cache_());
-        auto &pot(cache->pots_[{signer, funder}]);
-        if (pot != nullptr)
-            return {pot, false};
-        else {
-            pot = Make<Pot>();
-            return {pot, true};
-        }
+        const auto now(std::chrono::steady_clock::now());
+
+        const auto [value, inserted] = cache->pots_.Touch({signer, funder}, now);
+        if (!inserted)
+            return {value.pot_, std::exchange(value.warm_, false)};
+
+        value.pot_ = Make<Pot>();
+
+        auto pot(value.pot_);
+        Evict(cache, now, evicted);
+        return {std::move(pot), true};
     }();
 
+    for (const auto &[identity, subscription] : evicted)
+        orc_ignore({ co_await Unsubscribe(identity, subscription); });
+
     if (subscribe) {
+        // the look must come after the subscription, or an update landing between the two would be lost
+        co_await *watching_;
         auto combined(Combine(signer, funder));
 
-        co_await station_->Send("eth_subscribe", 'S' + combined, {"logs", Map{
-            {"address", lottery_},
-            {"topics", {{Update_, Bound_}, Number<uint256_t>(funder), Number<uint256_t>(signer)}},
-        }});
+        if (!multiplex_)
+            co_await station_->Send("eth_subscribe", 'S' + combined, {"logs", Map{
+                {"address", lottery_},
+                {"topics", {{Update_, Bound_}, Number<uint256_t>(funder), Number<uint256_t>(signer)}},
+            }});
 
         co_await Look(signer, funder, combined);
     }
 
     co_await **pot;
 
-    const auto locked(pot->locked_());
-    if (amount > locked->amount_)
-        co_return false;
-    if (amount > locked->escrow_ / 2)
-        co_return false;
-    if (locked->unlock_ != 0)
-        co_return false;
-    co_return true;
+    const auto valid([&]() {
+        const auto locked(pot->locked_());
+        if (amount > locked->amount_)
+            return false;
+        if (amount > locked->escrow_ / 2)
+            return false;
+        if (locked->unlock_ != 0)
+            return false;
+        return true;
+    }());
+
+    if (valid && first_ == -1) {
+        int64_t first(-1);
+        const auto elapsed(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - Boot_).count());
+        if (first_.compare_exchange_strong(first, elapsed))
+            Log() << "first ticket accepted after " << std::dec << elapsed << "ms" << std::endl;
+    }
+
+    co_return valid;
+}
+
+void Cashier::Metrics(std::ostream &out) const {
+    const auto cache(cache_());
+    out << "cashier_pots " << std::dec << cache->pots_.size() << "\n";
+    out << "cashier_subscriptions " << cache->subscriptions_ << "\n";
+    out << "cashier_evictions " << cache->evictions_ << "\n";
+    if (const auto first = first_.load(); first != -1)
+        out << "cashier_first_ticket_ms " << first << "\n";
 }
 
 }
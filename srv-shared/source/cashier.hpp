@@ -23,8 +23,12 @@
 #ifndef ORCHID_CASHIER_HPP
 #define ORCHID_CASHIER_HPP
 
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "endpoint.hpp"
 #include "event.hpp"
@@ -33,15 +37,25 @@
 #include "local.hpp"
 #include "locked.hpp"
 #include "locator.hpp"
+#include "money.hpp"
+#include "rates.hpp"
+#include "recent.hpp"
 #include "sleep.hpp"
 #include "signed.hpp"
+#include "snapshot.hpp"
 #include "spawn.hpp"
+#include "spool.hpp"
 #include "station.hpp"
 #include "updated.hpp"
 
 namespace orc {
 
-typedef std::tuple<Address, Address> Identity;
+struct IdentityHash {
+    size_t operator ()(const Identity &identity) const noexcept {
+        const std::hash<Address> hash;
+        return hash(std::get<0>(identity)) * 31 ^ hash(std::get<1>(identity));
+    }
+};
 
 static std::string Combine(const Address &signer, const Address &funder) {
     return Tie(signer, funder).hex();
@@ -50,11 +64,7 @@ static std::string Combine(const Address &signer, const Address &funder) {
 struct Pot :
     public Event
 {
-    struct Locked_ {
-        uint128_t amount_ = 0;
-        uint128_t escrow_ = 0;
-        uint256_t unlock_ = 0;
-    }; Locked<Locked_> locked_;
+    Locked<Balance> locked_;
 };
 
 class Cashier :
@@ -62,26 +72,55 @@ class Cashier :
     public Drain<Json::Value>
 {
   private:
-    const Endpoint endpoint_;
+    const S<Spool> spool_;
+    const S<Snapshot> snapshot_;
     const S<Updated<Fiat>> fiat_;
     const S<Gauge> gauge_;
 
-    const Float price_;
-
-    const Address personal_;
-    const std::string password_;
+    const Money price_;
 
     const Address lottery_;
     const uint256_t chain_;
     const Address recipient_;
 
     U<Station> station_;
+    // set by Open once logs are being delivered, so no Check looks up a pot before updates to it can arrive
+    Event watching_;
+
+    // rebuilt only when the gauge or the fiat updater refreshes
+    struct Table_ {
+        const S<Gauge::Prices_> prices_;
+        const Fiat fiat_;
+        const Rates rates_;
+
+        Table_(S<Gauge::Prices_> prices, Fiat fiat);
+    };
+
+    mutable S<const Table_> table_;
+    S<const Table_> Table() const;
+
+    const bool multiplex_;
+    const size_t maximum_;
+    const std::chrono::steady_clock::duration idle_;
+
+    struct Entry_ {
+        S<Pot> pot_;
+        std::string subscription_;
+        // loaded from the snapshot and not yet looked up again
+        bool warm_ = false;
+    };
 
     struct Cache_ {
-        std::map<uint128_t, Identity> subscriptions_;
-        std::map<Identity, S<Pot>> pots_;
+        Recent<Identity, Entry_, IdentityHash> pots_;
+        size_t subscriptions_ = 0;
+        uint64_t evictions_ = 0;
     }; Locked<Cache_> cache_;
 
+    std::atomic<int64_t> first_ = -1;
+
+    void Evict(const Lock<Cache_> &cache, std::chrono::steady_clock::time_point now, std::vector<std::pair<Identity, std::string>> &subscriptions);
+    task<void> Unsubscribe(const Identity &identity, const std::string &subscription);
+
     task<void> Look(const Address &signer, const Address &funder, const std::string &combined);
 
   protected:
@@ -89,7 +128,7 @@ class Cashier :
     void Stop(const std::string &error) noexcept override;
 
   public:
-    Cashier(Endpoint endpoint, S<Updated<Fiat>> fiat, S<Gauge> gauge, const Float &price, const Address &personal, std::string password, const Address &lottery, const uint256_t &chain, const Address &recipient);
+    Cashier(S<Spool> spool, S<Snapshot> snapshot, S<Updated<Fiat>> fiat, S<Gauge> gauge, const Money &price, const Address &lottery, const uint256_t &chain, const Address &recipient, bool multiplex, size_t maximum, unsigned idle);
     ~Cashier() override = default;
 
     void Open(S<Origin> origin, Locator locator);
@@ -99,26 +138,18 @@ class Cashier :
         return std::tie(lottery_, chain_, recipient_);
     }
 
-    Float Bill(size_t size) const;
-    checked_int256_t Convert(const Float &balance) const;
+    Money Bill(size_t size) const;
+    checked_int256_t Convert(const Money &balance) const;
 
-    std::pair<Float, uint256_t> Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const;
+    std::pair<Money, uint256_t> Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const;
     task<bool> Check(const Address &signer, const Address &funder, const uint128_t &amount, const Address &recipient, const Buffer &receipt);
 
+    void Metrics(std::ostream &out) const;
+
+    // XXX: that same disk queue should maybe be in charge of the old tickets?
     template <typename Selector_, typename... Args_>
     void Send(Selector_ &selector, const uint256_t &gas, const uint256_t &price, Args_ &&...args) {
-        Spawn([=]() mutable noexcept -> task<void> {
-            for (;;) {
-                orc_ignore({
-                    co_await selector.Send(endpoint_, personal_, password_, lottery_, gas, price, std::forward<Args_>(args)...);
-                    break;
-                });
-
-                // XXX: I should dump these to a disk queue as they are worth "real money"
-                // XXX: that same disk queue should maybe be in charge of the old tickets?
-                co_await Sleep(5000);
-            }
-        });
+        spool_->Push(gas, price, selector(std::forward<Args_>(args)...));
     }
 };
 
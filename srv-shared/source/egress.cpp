@@ -20,69 +20,305 @@
 /* }}} */
 
 
+#include <algorithm>
+
 #include "egress.hpp"
 #include "forge.hpp"
+#include "sleep.hpp"
+#include "spawn.hpp"
 
 namespace orc {
 
-Socket Egress::Translator::Translate(const Three &source) {
+// only the headers that get rewritten are copied out; the payload is forwarded from the buffer it arrived in
+class Rewrite final :
+    public Buffer
+{
+  private:
+    // the largest IPv4 header (with options) followed by the largest fixed transport header we patch
+    std::array<uint8_t, 60 + sizeof(openvpn::TCPHeader)> header_;
+    size_t size_;
+    Window rest_;
+
+  public:
+    Rewrite(const Buffer &data) :
+        size_(sizeof(openvpn::IPv4Header)),
+        rest_(data)
+    {
+        rest_.Take(header_.data(), size_);
+        const auto &ip4(*reinterpret_cast<const openvpn::IPv4Header *>(header_.data()));
+        const auto length(openvpn::IPv4Header::length(ip4.version_len));
+        orc_assert(length >= size_ && length <= 60);
+
+        const auto need(length + [&]() -> size_t {
+            switch (ip4.protocol) {
+                case openvpn::IPCommon::TCP:
+                    return sizeof(openvpn::TCPHeader);
+                case openvpn::IPCommon::UDP:
+                    return sizeof(openvpn::UDPHeader);
+                case openvpn::IPCommon::ICMPv4:
+                    return sizeof(openvpn::ICMPv4) - sizeof(openvpn::IPv4Header);
+                default:
+                    return 0;
+            }
+        }());
+
+        rest_.Take(header_.data() + size_, need - size_);
+        size_ = need;
+    }
+
+    Span<> span() {
+        return {header_.data(), size_};
+    }
+
+    bool each(const std::function<bool (const uint8_t *, size_t)> &code) const override {
+        return code(header_.data(), size_) && rest_.each(code);
+    }
+};
+
+std::optional<Socket> Egress::Translator::Translate(const Three &source, uint8_t state) {
+    std::optional<Socket> translated;
+    bool closing(false);
+
     { const auto locked(locked_());
         const auto internal(locked->internals_.find(source));
-        if (internal != locked->internals_.end())
-            return internal->second.translated_; }
-    return egress_->Translate(indirect_, source);
+        if (internal != locked->internals_.end()) {
+            auto &slot(*internal->second.slot_);
+            slot.used_.store(true, std::memory_order_relaxed);
+            slot.seen_.store(egress_->Now(), std::memory_order_relaxed);
+            if (state != 0) {
+                const auto before(slot.state_.fetch_or(state, std::memory_order_relaxed));
+                closing = (before | state) != before;
+            }
+            translated = internal->second.translated_;
+        } }
+
+    if (!translated)
+        return egress_->Translate(indirect_, source, state);
+    if (closing)
+        egress_->Refile(pool_, translated->Port());
+    return translated;
 }
 
-Socket Egress::Translate(Translators::iterator translator, const Three &source) {
-    const auto locked(locked_());
-    auto &externals(locked->externals_);
-    auto &recents(locked->recents_);
-
-    if (const auto translated = translator->first->Access([&](auto &internals) -> std::optional<Socket> {
-        const auto internal(internals.find(source));
-        if (internal == internals.end())
-            return {};
-        return {{Socket(internal->second.translated_)}};
-    }))
-        return *translated;
+Egress::Pool::Pool(uint32_t local) :
+    local_(local)
+{
+}
+
+Egress::Egress(const std::vector<uint32_t> &locals, size_t flows, uint32_t rate) :
+    epoch_(std::chrono::steady_clock::now()),
+    flows_(flows),
+    rate_(rate)
+{
+    orc_assert(!locals.empty());
+    for (const auto local : locals) {
+        pools_.emplace_back(std::make_unique<Pool>(local));
+        orc_assert_(locals_.try_emplace(local, pools_.back().get()).second, "duplicate egress address " << Host(local));
+    }
+}
 
-    auto ephemeral(ephemeral_ + recents.size());
-    if (ephemeral == 0x10000) {
-        const auto recent(recents.back());
-        recents.pop_back();
-        ephemeral = recent.Port();
-
-        const auto external(externals.find(recent));
-        if (external != externals.end()) {
-            external->second.indirect_->first->Access([&](auto &internals) {
-                orc_insist(internals.erase(Three(recent.Protocol(), external->second.translated_)) != 0);
-            });
-            externals.erase(external);
+void Egress::Open() {
+    Spawn([this]() noexcept -> task<void> {
+        for (;;) {
+            co_await Sleep(Tick_ * 1000);
+            const auto now(Now());
+            for (const auto &pool : pools_)
+                for (auto &shard : pool->shards_)
+                    Expire(*pool, *shard(), now);
         }
+    });
+}
+
+Egress::Pool &Egress::Assign() {
+    // clients are spread by count rather than by traffic, as moving one later would break its flows
+    const auto pool(std::min_element(pools_.begin(), pools_.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs->clients_ < rhs->clients_;
+    }));
+    ++(*pool)->clients_;
+    return **pool;
+}
+
+size_t Egress::Index(uint8_t protocol) {
+    switch (protocol) {
+        case openvpn::IPCommon::TCP:
+            return 0;
+        case openvpn::IPCommon::UDP:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+uint32_t Egress::Timeout(const Slot &slot) {
+    switch (slot.protocol_) {
+        case openvpn::IPCommon::TCP: {
+            const auto state(slot.state_.load(std::memory_order_relaxed));
+            if ((state & Reset) != 0 || (state & (FinOut | FinIn)) == (FinOut | FinIn))
+                return Closed_;
+            if ((state & Replied) != 0 && (state & (FinOut | FinIn)) == 0)
+                return Established_;
+            return Transitory_;
+        }
+
+        case openvpn::IPCommon::UDP:
+            return Datagram_;
+        default:
+            return Query_;
     }
+}
+
+void Egress::File(Shard &shard, uint16_t index, uint32_t when) {
+    shard.wheel_.File(index, shard.ports_[index].generation_, when);
+}
 
-    const auto translated(Three(source.Protocol(), local_, ephemeral));
-    recents.emplace_front(translated);
-    const auto external(externals.emplace(translated, External{source.Two(), translator, recents.begin()}));
-    orc_insist(external.second);
-    translator->first->Access([&](auto &internals) {
-        orc_insist(internals.emplace(source, Internal{translated.Two(), external.first}).second);
+// a FIN or RST can shorten a flow's timeout, which its wheel entry (filed for the old one) would only notice late
+void Egress::Refile(Pool &pool, uint16_t port) {
+    const auto offset(port - Ephemeral_);
+    const auto shard(pool.shards_[offset % Shards_]());
+    const auto index(offset / Shards_);
+    auto &slot(shard->ports_[index]);
+    if (slot.Live())
+        File(*shard, index, slot.seen_.load(std::memory_order_relaxed) + Timeout(slot));
+}
+
+void Egress::Unlink(Slot &slot) {
+    const auto translator(slot.indirect_->first);
+    translator->Access([&](auto &locked) {
+        // the translator might be in the middle of shutting down, having already taken its internals
+        if (locked.internals_.erase(Three(slot.protocol_, slot.translated_)) != 0)
+            --translator->count_;
     });
-    return translated.Two();
 }
 
-std::optional<Egress::Translation> Egress::Find(const Three &destination) {
-    const auto locked(locked_());
-    const auto external(locked->externals_.find(destination));
-    if (external == locked->externals_.end())
+void Egress::Release(Pool &pool, Shard &shard, uint16_t index) {
+    auto &slot(shard.ports_[index]);
+    --pool.flows_[Index(slot.protocol_)];
+    --pool.used_;
+    slot.protocol_ = 0;
+    shard.ports_.Free(index);
+}
+
+uint16_t Egress::Claim(Pool &pool, Shard &shard) {
+    auto &ports(shard.ports_);
+    if (ports.Full()) {
+        // a translator holding more than an even split of the pool is who pays for the pressure
+        const auto share(Shards_ * Slots_ / std::max<size_t>(pool.clients_, 1));
+        const auto index(ports.Victim([&](const Slot &slot) {
+            return slot.indirect_->first->count_.load(std::memory_order_relaxed) > share;
+        }));
+
+        Unlink(ports[index]);
+        Release(pool, shard, index);
+        ++pool.evictions_;
+    }
+
+    ++pool.used_;
+    return ports.Take();
+}
+
+void Egress::Expire(Pool &pool, Shard &shard, uint32_t now) {
+    shard.wheel_.Turn(now, [&](uint16_t index, uint32_t generation) -> uint32_t {
+        auto &slot(shard.ports_[index]);
+        if (!slot.Live() || slot.generation_ != generation)
+            return 0;
+
+        const auto deadline(slot.seen_.load(std::memory_order_relaxed) + Timeout(slot));
+        if (deadline > now)
+            return deadline;
+
+        Unlink(slot);
+        Release(pool, shard, index);
+        ++pool.expirations_;
+        return 0;
+    });
+}
+
+bool Egress::Admit(Pool &pool, Translator::Locked_ &locked) {
+    if (flows_ != 0 && locked.internals_.size() >= flows_) {
+        ++pool.capped_;
+        return false;
+    }
+
+    if (rate_ != 0 && !locked.bucket_(rate_, Now())) {
+        ++pool.limited_;
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<Socket> Egress::Translate(Translators::iterator translator, const Three &source, uint8_t state) {
+    // the same source always lands on the same shard, so this lock also serializes racing misses for it
+    auto &pool(translator->first->pool_);
+    const auto index(std::hash<Three>()(source) % Shards_);
+    const auto shard(pool.shards_[index]());
+
+    // a translator over its limits has the new flow dropped, rather than pushing out somebody else's
+    if (const auto translated = translator->first->Access([&](auto &locked) -> std::optional<std::optional<Socket>> {
+        orc_assert_(!locked.closed_, "translator is shut");
+        const auto internal(locked.internals_.find(source));
+        if (internal != locked.internals_.end())
+            return std::make_optional(std::make_optional(internal->second.translated_));
+        if (!Admit(pool, locked))
+            return std::make_optional(std::optional<Socket>());
+        return std::nullopt;
+    }))
+        return *translated;
+
+    const auto now(Now());
+    const auto claimed(Claim(pool, *shard));
+    auto &slot(shard->ports_[claimed]);
+    slot.indirect_ = translator;
+    slot.protocol_ = source.Protocol();
+    slot.translated_ = source.Two();
+    ++slot.generation_;
+    slot.used_.store(true, std::memory_order_relaxed);
+    slot.seen_.store(now, std::memory_order_relaxed);
+    slot.state_.store(state, std::memory_order_relaxed);
+    ++pool.flows_[Index(slot.protocol_)];
+    File(*shard, claimed, now + Timeout(slot));
+
+    const Socket translated(pool.local_, Port(index, claimed));
+    // Shut may have taken the internals while the slot was being claimed, and would never see this one
+    if (!translator->first->Access([&](auto &locked) {
+        if (locked.closed_)
+            return false;
+        orc_insist(locked.internals_.emplace(source, Internal{translated, &slot}).second);
+        ++translator->first->count_;
+        return true;
+    })) {
+        Release(pool, *shard, claimed);
+        return {};
+    }
+
+    return translated;
+}
+
+std::optional<Egress::Translation> Egress::Find(const Three &destination, uint8_t state) {
+    const auto port(destination.Port());
+    if (port < Ephemeral_)
+        return {};
+    const auto local(locals_.find(destination.Host()));
+    if (local == locals_.end())
         return {};
-    auto &recents(locked->recents_);
-    recents.splice(recents.begin(), recents, external->second.recent_);
-    ++external->second.indirect_->second->usage_;
-    return {Translation(external->second.translated_, *external->second.indirect_->first, external->second.indirect_->second)};
+    const auto offset(port - Ephemeral_);
+
+    const auto shard(local->second->shards_[offset % Shards_]());
+    auto &slot(shard->ports_[offset / Shards_]);
+    if (slot.protocol_ != destination.Protocol())
+        return {};
+    const auto now(Now());
+    slot.used_.store(true, std::memory_order_relaxed);
+    slot.seen_.store(now, std::memory_order_relaxed);
+    const auto before(slot.state_.fetch_or(state | Replied, std::memory_order_relaxed));
+    if ((before | state) != before)
+        File(*shard, offset / Shards_, now + Timeout(slot));
+    ++slot.indirect_->second->usage_;
+    return {Translation(slot.translated_, *slot.indirect_->first, slot.indirect_->second)};
 }
 
-Egress::Translators::iterator Egress::Open(Translator *translator, Neutral *neutral) {
+Egress::Translators::iterator Egress::Open(Translator *translator, Neutral *neutral, uint32_t weight) {
+    fair_()->Open(translator, weight);
+
     const auto locked(locked_());
     const auto emplaced(locked->translators_.try_emplace(translator, neutral));
     orc_insist(emplaced.second);
@@ -92,23 +328,32 @@ Egress::Translators::iterator Egress::Open(Translator *translator, Neutral *neut
 task<void> Egress::Shut(Translators::iterator indirect) noexcept {
     const auto translator(indirect->first);
     auto &neutral(*indirect->second);
+    auto &pool(translator->pool_);
 
-    {
-        const auto locked(locked_());
-        auto &externals(locked->externals_);
-        auto &recents(locked->recents_);
-
-        translator->Access([&](auto &internals) {
-            for (const auto &[source, internal] : internals) {
-                const auto external(internal.external_);
-                orc_insist(external->second.indirect_ == indirect);
-                recents.splice(recents.begin(), recents, external->second.recent_);
-                externals.erase(external);
-            }
+    const auto internals(translator->Access([&](auto &locked) {
+        locked.closed_ = true;
+        translator->count_ = 0;
+        return std::move(locked.internals_);
+    }));
+
+    // the translator lock is never held while taking a shard lock, so this returns slots one shard at a time
+    for (const auto &[source, internal] : internals) {
+        const auto offset(internal.translated_.Port() - Ephemeral_);
+        const auto shard(pool.shards_[offset % Shards_]());
+        auto &slot(*internal.slot_);
+        if (!slot.Live() || slot.indirect_ != indirect)
+            continue;
+        Release(pool, *shard, offset / Shards_);
+    }
+
+    --pool.clients_;
 
-            internals.clear();
-        });
+    // anything still waiting for the transport is dropped, as its translator is going away
+    for (const auto waiter : fair_()->Close(translator))
+        waiter->ready_();
 
+    {
+        const auto locked(locked_());
         locked->translators_.erase(indirect);
 
         neutral.shutting_ = true;
@@ -120,9 +365,39 @@ task<void> Egress::Shut(Translators::iterator indirect) noexcept {
     translator->Stop();
 }
 
+task<bool> Egress::Turn(Translator *translator, size_t size) {
+    Waiter waiter{size, std::chrono::steady_clock::now()};
+    if (const auto granted = fair_()->Turn(translator, waiter))
+        co_return *granted;
+    co_await *waiter.ready_;
+    co_return waiter.granted_;
+}
+
+void Egress::Next() {
+    if (const auto next = fair_()->Next())
+        next->ready_();
+}
+
+task<void> Egress::Send(Translator *translator, const Buffer &data) {
+    if (!co_await Turn(translator, data.size()))
+        co_return;
+
+    // the turn has to be passed on even if this send fails
+    std::exception_ptr error;
+    try {
+        co_await Send(data);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    Next();
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
 task<void> Egress::Translator::Send(const Buffer &data) {
-    Beam beam(data);
-    auto span(beam.span());
+    Rewrite rewrite(data);
+    auto span(rewrite.span());
     auto &ip4(span.cast<openvpn::IPv4Header>());
     const auto length(openvpn::IPv4Header::length(ip4.version_len));
 
@@ -130,35 +405,41 @@ task<void> Egress::Translator::Send(const Buffer &data) {
         case openvpn::IPCommon::TCP: {
             auto &tcp(span.cast<openvpn::TCPHeader>(length));
             const Three source(openvpn::IPCommon::TCP, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(tcp.source));
-            const auto translated(Translate(source));
-            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated.Host());
-            Forge(tcp, &openvpn::TCPHeader::source, translated.Port());
-            co_return co_await egress_->Send(beam);
+            const auto translated(Translate(source, State(tcp.flags, FinOut)));
+            if (!translated)
+                co_return;
+            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated->Host());
+            Forge(tcp, &openvpn::TCPHeader::source, translated->Port());
+            co_return co_await egress_->Send(this, rewrite);
         } break;
 
         case openvpn::IPCommon::UDP: {
             auto &udp(span.cast<openvpn::UDPHeader>(length));
             const Three source(openvpn::IPCommon::UDP, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(udp.source));
-            const auto translated(Translate(source));
-            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated.Host());
-            Forge(udp, &openvpn::UDPHeader::source, translated.Port());
-            co_return co_await egress_->Send(beam);
+            const auto translated(Translate(source, 0));
+            if (!translated)
+                co_return;
+            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated->Host());
+            Forge(udp, &openvpn::UDPHeader::source, translated->Port());
+            co_return co_await egress_->Send(this, rewrite);
         } break;
 
         case openvpn::IPCommon::ICMPv4: {
             auto &icmp(span.cast<openvpn::ICMPv4>());
             const Three source(openvpn::IPCommon::ICMPv4, boost::endian::big_to_native(ip4.saddr), boost::endian::big_to_native(icmp.id));
-            const auto translated(Translate(source));
-            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated.Host());
-            Forge(icmp, &openvpn::ICMPv4::id, translated.Port());
-            co_return co_await egress_->Send(beam);
+            const auto translated(Translate(source, 0));
+            if (!translated)
+                co_return;
+            ForgeIP4(span, &openvpn::IPv4Header::saddr, translated->Host());
+            Forge(icmp, &openvpn::ICMPv4::id, translated->Port());
+            co_return co_await egress_->Send(this, rewrite);
         } break;
     }
 }
 
 void Egress::Land(const Buffer &data) {
-    Beam beam(data);
-    auto span(beam.span());
+    Rewrite rewrite(data);
+    auto span(rewrite.span());
     auto &ip4(span.cast<openvpn::IPv4Header>());
     const auto length(openvpn::IPv4Header::length(ip4.version_len));
 
@@ -166,35 +447,63 @@ void Egress::Land(const Buffer &data) {
         case openvpn::IPCommon::TCP: {
             auto &tcp(span.cast<openvpn::TCPHeader>(length));
             const Three destination(openvpn::IPCommon::TCP, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(tcp.dest));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, State(tcp.flags, FinIn))) {
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, translation->translated_.Host());
                 Forge(tcp, &openvpn::TCPHeader::dest, translation->translated_.Port());
-                return translation->translator_.Land(beam);
+                return translation->translator_.Land(rewrite);
             }
         } break;
 
         case openvpn::IPCommon::UDP: {
             auto &udp(span.cast<openvpn::UDPHeader>(length));
             const Three destination(openvpn::IPCommon::UDP, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(udp.dest));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, 0)) {
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, translation->translated_.Host());
                 Forge(udp, &openvpn::UDPHeader::dest, translation->translated_.Port());
-                return translation->translator_.Land(beam);
+                return translation->translator_.Land(rewrite);
             }
         } break;
 
         case openvpn::IPCommon::ICMPv4: {
             auto &icmp(span.cast<openvpn::ICMPv4>());
             const Three destination(openvpn::IPCommon::ICMPv4, boost::endian::big_to_native(ip4.daddr), boost::endian::big_to_native(icmp.id));
-            if (const auto translation = Find(destination)) {
+            if (const auto translation = Find(destination, 0)) {
                 ForgeIP4(span, &openvpn::IPv4Header::daddr, translation->translated_.Host());
                 Forge(icmp, &openvpn::ICMPv4::id, translation->translated_.Port());
-                return translation->translator_.Land(beam);
+                return translation->translator_.Land(rewrite);
             }
         } break;
     }
 }
 
+void Egress::Metrics(std::ostream &out) const {
+    for (const auto &pool : pools_) {
+        const auto address(Host(pool->local_).String());
+        out << "egress_clients{address=\"" << address << "\"} " << std::dec << pool->clients_.load() << "\n";
+        out << "egress_ports_used{address=\"" << address << "\"} " << pool->used_.load() << "\n";
+        out << "egress_ports_total{address=\"" << address << "\"} " << Shards_ * Slots_ << "\n";
+        out << "egress_evictions{address=\"" << address << "\"} " << pool->evictions_.load() << "\n";
+        out << "egress_expirations{address=\"" << address << "\"} " << pool->expirations_.load() << "\n";
+        out << "egress_limit_flows{address=\"" << address << "\"} " << pool->capped_.load() << "\n";
+        out << "egress_limit_rate{address=\"" << address << "\"} " << pool->limited_.load() << "\n";
+        static const char *const protocols[] = {"tcp", "udp", "icmp"};
+        for (size_t i(0); i != pool->flows_.size(); ++i)
+            out << "egress_flows{address=\"" << address << "\",protocol=\"" << protocols[i] << "\"} " << pool->flows_[i].load() << "\n";
+    }
+
+    const auto fair(fair_());
+    for (const auto &[translator, queue] : fair->queues())
+        Metrics(out, queue);
+}
+
+void Egress::Metrics(std::ostream &out, const Fair_::Queue &queue) {
+    const auto client(std::to_string(queue.id_));
+    out << "egress_queue_depth{client=\"" << client << "\"} " << queue.waiting_.size() << "\n";
+    out << "egress_queue_sent{client=\"" << client << "\"} " << queue.sent_ << "\n";
+    out << "egress_queue_dropped{client=\"" << client << "\"} " << queue.dropped_ << "\n";
+    out << "egress_queue_delay_us{client=\"" << client << "\"} " << queue.delay_.count() << "\n";
+}
+
 void Egress::Stop(const std::string &error) noexcept {
     const auto locked(locked_());
     for (const auto &translator : locked->translators_)
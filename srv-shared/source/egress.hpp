@@ -23,14 +23,21 @@
 #ifndef ORCHID_EGRESS_HPP
 #define ORCHID_EGRESS_HPP
 
-// XXX: there is a serious denial of service attack in this system
-
+#include <array>
+#include <chrono>
+#include <deque>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
+#include "bucket.hpp"
 #include "event.hpp"
+#include "fair.hpp"
 #include "link.hpp"
 #include "locked.hpp"
+#include "ports.hpp"
 #include "socket.hpp"
+#include "wheel.hpp"
 
 namespace orc {
 
@@ -41,11 +48,49 @@ class Egress :
     public Sunken<Pump<Buffer>>
 {
   private:
-    const uint32_t local_;
-    const uint16_t ephemeral_ = 4096;
+    static const uint16_t Ephemeral_ = 4096;
+    // ports are dealt out to shards by (port - Ephemeral_) % Shards_, so each shard owns a fixed slice of them
+    static const size_t Shards_ = 16;
+    static const size_t Slots_ = (0x10000 - Ephemeral_) / Shards_;
+
+    // idle timeouts in seconds, after RFC 5382 (TCP), RFC 4787 (UDP) and RFC 5508 (ICMP)
+    static const uint32_t Established_ = 7440;
+    static const uint32_t Transitory_ = 240;
+    static const uint32_t Closed_ = 10;
+    static const uint32_t Datagram_ = 300;
+    static const uint32_t Query_ = 60;
+
+    // expiry is checked lazily from a wheel of Wheel_ buckets, each Tick_ seconds wide
+    static const uint32_t Tick_ = 4;
+    static const size_t Wheel_ = 512;
+
+    // accumulated per slot from the TCP flags seen in either direction
+    enum : uint8_t {
+        FinOut = 0x01,
+        FinIn = 0x02,
+        Reset = 0x04,
+        Replied = 0x08,
+    };
+
+    const std::chrono::steady_clock::time_point epoch_;
+
+    // per translator: concurrent mappings, and new mappings per second (0 for no limit)
+    const size_t flows_;
+    const uint32_t rate_;
+
+    // a sender parks one of these (and keeps its own buffer) until the transport is granted to it
+    struct Waiter {
+        const size_t size_;
+        const std::chrono::steady_clock::time_point queued_;
+        bool granted_ = false;
+        Event ready_;
+    };
 
     class Translator;
 
+    typedef Fair<Translator *, Waiter> Fair_;
+    Locked<Fair_> fair_;
+
     struct Neutral {
         std::atomic<unsigned> usage_ = 0;
         std::atomic<bool> shutting_ = false;
@@ -53,7 +98,6 @@ class Egress :
     };
 
     typedef std::map<Translator *, Neutral *> Translators;
-    typedef std::list<const Three> Recents;
 
     struct Translation {
         const Socket translated_;
@@ -83,25 +127,59 @@ class Egress :
         }
     };
 
-    struct External {
-        const Socket translated_;
-        const Translators::iterator indirect_;
-        const Recents::iterator recent_;
+    // one per external port, owned by whichever translator last claimed it
+    struct Slot {
+        // set by traffic and cleared by the clock hand, which replaces splicing an LRU list on every packet
+        std::atomic<bool> used_ = false;
+        // also written by traffic without the shard lock; only the wheel acts on them
+        std::atomic<uint32_t> seen_ = 0;
+        std::atomic<uint8_t> state_ = 0;
+
+        Translators::iterator indirect_;
+        uint8_t protocol_ = 0;
+        Socket translated_;
+        // bumped on every claim, so stale wheel entries for a reused slot can be told apart
+        uint32_t generation_ = 0;
+
+        bool Live() const {
+            return protocol_ != 0;
+        }
+    };
+
+    struct Shard {
+        Ports<Slot> ports_{Slots_};
+        Wheel wheel_{Tick_, Wheel_};
     };
 
-    typedef std::map<Three, External> Externals;
+    // each egress address has its own ports; a translator keeps the address it was first given
+    struct Pool {
+        const uint32_t local_;
+        std::array<Locked<Shard>, Shards_> shards_;
+
+        std::atomic<size_t> clients_ = 0;
+        std::atomic<size_t> used_ = 0;
+        std::atomic<uint64_t> evictions_ = 0;
+        std::atomic<uint64_t> expirations_ = 0;
+        std::atomic<uint64_t> capped_ = 0;
+        std::atomic<uint64_t> limited_ = 0;
+        // indexed by Index(protocol)
+        std::array<std::atomic<size_t>, 3> flows_ = {};
+
+        Pool(uint32_t local);
+    };
+
+    std::vector<U<Pool>> pools_;
+    std::unordered_map<uint32_t, Pool *> locals_;
 
     struct Internal {
         const Socket translated_;
-        const Externals::iterator external_;
+        Slot *const slot_;
     };
 
-    typedef std::map<Three, Internal> Internals;
+    typedef std::unordered_map<Three, Internal> Internals;
 
     struct Locked_ {
-        Externals externals_;
         Translators translators_;
-        Recents recents_;
     }; Locked<Locked_> locked_;
 
     class Translator:
@@ -112,25 +190,32 @@ class Egress :
       private:
         const S<Egress> egress_;
         Neutral neutral_;
+        Pool &pool_;
         const Translators::iterator indirect_;
 
+        // mirrors internals_.size(), for the clock hand to read without taking this lock
+        std::atomic<size_t> count_ = 0;
+
         struct Locked_ {
             Internals internals_;
+            bool closed_ = false;
+            Bucket bucket_;
         }; Locked<Locked_> locked_;
 
-        Socket Translate(const Three &source);
+        std::optional<Socket> Translate(const Three &source, uint8_t state);
 
         template <typename Code_>
-        auto Access(const Code_ &code) -> decltype(code(std::declval<Internals &>())) {
+        auto Access(const Code_ &code) -> decltype(code(std::declval<Locked_ &>())) {
             const auto locked(locked_());
-            return code(locked->internals_);
+            return code(*locked);
         }
 
       public:
-        Translator(BufferDrain &drain, S<Egress> egress) :
+        Translator(BufferDrain &drain, S<Egress> egress, uint32_t weight) :
             Link(drain),
             egress_(std::move(egress)),
-            indirect_(egress_->Open(this, &neutral_))
+            pool_(egress_->Assign()),
+            indirect_(egress_->Open(this, &neutral_, weight))
         {
         }
 
@@ -142,34 +227,71 @@ class Egress :
         task<void> Send(const Buffer &data) override;
     };
 
-    Socket Translate(Translators::iterator, const Three &source);
-    std::optional<Translation> Find(const Three &destination);
+    static uint16_t Port(size_t shard, size_t slot) {
+        return uint16_t(Ephemeral_ + slot * Shards_ + shard);
+    }
+
+    Pool &Assign();
+
+    // FIN and RST are the low bits of the TCP flags byte
+    static uint8_t State(uint8_t flags, uint8_t fin) {
+        return ((flags & 0x01) != 0 ? fin : 0) | ((flags & 0x04) != 0 ? Reset : 0);
+    }
+
+    static size_t Index(uint8_t protocol);
+    static uint32_t Timeout(const Slot &slot);
+
+    uint32_t Now() const {
+        return uint32_t(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - epoch_).count());
+    }
+
+    static void File(Shard &shard, uint16_t index, uint32_t when);
+    void Refile(Pool &pool, uint16_t port);
+    static void Unlink(Slot &slot);
+    static void Release(Pool &pool, Shard &shard, uint16_t index);
+
+    uint16_t Claim(Pool &pool, Shard &shard);
+    void Expire(Pool &pool, Shard &shard, uint32_t now);
 
-    Translators::iterator Open(Translator *translator, Neutral *neutral);
+    bool Admit(Pool &pool, Translator::Locked_ &locked);
+    std::optional<Socket> Translate(Translators::iterator, const Three &source, uint8_t state);
+    std::optional<Translation> Find(const Three &destination, uint8_t state);
+
+    Translators::iterator Open(Translator *translator, Neutral *neutral, uint32_t weight);
     task<void> Shut(Translators::iterator indirect) noexcept;
 
+    task<bool> Turn(Translator *translator, size_t size);
+    void Next();
+
     task<void> Send(const Buffer &data) {
         co_await Inner().Send(data);
     }
 
+    task<void> Send(Translator *translator, const Buffer &data);
+
+    static void Metrics(std::ostream &out, const Fair_::Queue &queue);
+
   protected:
     void Land(const Buffer &data) override;
     void Stop(const std::string &error) noexcept override;
 
   public:
-    Egress(uint32_t local) :
-        local_(local)
-    {
-    }
+    Egress(const std::vector<uint32_t> &locals, size_t flows, uint32_t rate);
 
     ~Egress() override {
         orc_insist(false);
     }
 
-    void Wire(BufferSunk &sunk) {
-        sunk.Wire<Translator>(shared_from_this());
+    // starts the worker that expires idle flows
+    void Open();
+
+    void Wire(BufferSunk &sunk, uint32_t weight = 1) {
+        orc_assert(weight != 0);
+        sunk.Wire<Translator>(shared_from_this(), weight);
     }
 
+    void Metrics(std::ostream &out) const;
+
     task<void> Shut() noexcept override {
         co_await Sunken::Shut();
         co_await Valve::Shut();
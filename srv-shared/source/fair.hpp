@@ -0,0 +1,155 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_FAIR_HPP
+#define ORCHID_FAIR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+
+namespace orc {
+
+// packets from each key's queue take turns by deficit round robin, Quantum_ bytes per unit of weight per round;
+// Waiter_ has a size_, when it was queued_ and granted_ (set here), and whoever holds this wakes what it returns
+template <typename Key_, typename Waiter_>
+class Fair {
+  public:
+    static const size_t Quantum_ = 1500;
+    static const size_t Depth_ = 64;
+    // how many granted packets may be with the transport at once: enough to keep it busy, few enough that
+    // a queue that just became active does not wait behind a long line of someone else's packets
+    static const size_t Flight_ = 16;
+
+    struct Queue {
+        const uint64_t id_;
+        const uint32_t weight_;
+
+        size_t deficit_ = 0;
+        bool active_ = false;
+        std::deque<Waiter_ *> waiting_;
+
+        uint64_t sent_ = 0;
+        uint64_t dropped_ = 0;
+        std::chrono::microseconds delay_ = {};
+    };
+
+  private:
+    std::unordered_map<Key_, Queue> queues_;
+    std::deque<Queue *> active_;
+    // granted packets not yet accepted by the transport; below Flight_ only while nobody is waiting
+    size_t flight_ = 0;
+    uint64_t next_ = 0;
+
+  public:
+    const std::unordered_map<Key_, Queue> &queues() const {
+        return queues_;
+    }
+
+    bool Waiting() const {
+        return !active_.empty();
+    }
+
+    size_t Flight() const {
+        return flight_;
+    }
+
+    void Open(const Key_ &key, uint32_t weight) {
+        orc_insist(queues_.try_emplace(key, Queue{next_++, weight}).second);
+    }
+
+    // returns what was still waiting, none of which will be granted
+    std::vector<Waiter_ *> Close(const Key_ &key) {
+        const auto queue(queues_.find(key));
+        orc_insist(queue != queues_.end());
+        std::vector<Waiter_ *> waiting(queue->second.waiting_.begin(), queue->second.waiting_.end());
+        active_.erase(std::remove(active_.begin(), active_.end(), &queue->second), active_.end());
+        queues_.erase(queue);
+        return waiting;
+    }
+
+    // an answer now (whether it may send), or nothing if waiter was queued to be returned by a later Next
+    std::optional<bool> Turn(const Key_ &key, Waiter_ &waiter) {
+        const auto queue(queues_.find(key));
+        if (queue == queues_.end())
+            return false;
+        auto &value(queue->second);
+
+        if (flight_ != Flight_ && active_.empty()) {
+            ++flight_;
+            ++value.sent_;
+            return true;
+        }
+
+        if (value.waiting_.size() >= Depth_) {
+            ++value.dropped_;
+            return false;
+        }
+
+        value.waiting_.emplace_back(&waiter);
+        if (!value.active_) {
+            value.active_ = true;
+            value.deficit_ = 0;
+            active_.emplace_back(&value);
+        }
+
+        return std::nullopt;
+    }
+
+    // a finished send frees exactly one slot, so it hands on at most one grant
+    Waiter_ *Next() {
+        while (!active_.empty()) {
+            auto &queue(*active_.front());
+            if (queue.waiting_.empty()) {
+                queue.active_ = false;
+                active_.pop_front();
+                continue;
+            }
+
+            const auto waiter(queue.waiting_.front());
+            if (queue.deficit_ < waiter->size_) {
+                queue.deficit_ += Quantum_ * queue.weight_;
+                active_.pop_front();
+                active_.emplace_back(&queue);
+                continue;
+            }
+
+            queue.deficit_ -= waiter->size_;
+            queue.waiting_.pop_front();
+            ++queue.sent_;
+            queue.delay_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waiter->queued_);
+            waiter->granted_ = true;
+            return waiter;
+        }
+
+        --flight_;
+        return nullptr;
+    }
+};
+
+}
+
+#endif//ORCHID_FAIR_HPP
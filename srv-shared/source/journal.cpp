@@ -0,0 +1,61 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include "journal.hpp"
+#include "sleep.hpp"
+#include "spawn.hpp"
+
+namespace orc {
+
+Journal::Journal(unsigned interval) :
+    interval_(interval)
+{
+}
+
+task<void> Journal::Persist() noexcept {
+    while (!stopping_) {
+        if (interval_ == 0) {
+            co_await pushed_;
+            co_await Schedule();
+        } else
+            co_await Sleep(interval_);
+
+        // a failed pass keeps whatever it could not write, so keep trying (rather than waiting for the next push)
+        while (orc_ignore({ Commit(); }) && !stopping_)
+            co_await Sleep(1000);
+    }
+
+    co_await Settle();
+    orc_ignore({ Commit(); });
+    Stop();
+}
+
+void Journal::Open() {
+    Spawn([this]() noexcept { return Persist(); });
+}
+
+task<void> Journal::Shut() noexcept {
+    stopping_ = true;
+    pushed_.set();
+    co_await Valve::Shut();
+}
+
+}
@@ -0,0 +1,119 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_JOURNAL_HPP
+#define ORCHID_JOURNAL_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <cppcoro/async_auto_reset_event.hpp>
+
+#include "database.hpp"
+#include "locked.hpp"
+#include "valve.hpp"
+
+namespace orc {
+
+// rows queued from any thread for a Journal's Commit to write out together; if writing them fails
+// they are put back, ahead of anything queued meanwhile, so the next pass writes them in order
+template <typename Row_>
+class Batch {
+  private:
+    Locked<std::vector<Row_>> rows_;
+
+  public:
+    void Push(Row_ row) {
+        rows_()->emplace_back(std::move(row));
+    }
+
+    template <typename Code_>
+    void Take(Code_ &&code) {
+        std::vector<Row_> rows;
+        std::swap(rows, *rows_());
+
+        if (rows.empty())
+            return;
+
+        try {
+            code(rows);
+        } catch (...) {
+            const auto locked(rows_());
+            rows.insert(rows.end(), std::make_move_iterator(locked->begin()), std::make_move_iterator(locked->end()));
+            *locked = std::move(rows);
+            throw;
+        }
+    }
+};
+
+// a sqlite file written in batches: subclasses queue rows in memory and Commit writes them out from a worker of its own
+class Journal :
+    public Valve
+{
+  private:
+    const unsigned interval_;
+    cppcoro::async_auto_reset_event pushed_;
+
+    task<void> Persist() noexcept;
+
+  protected:
+    std::atomic<bool> stopping_ = false;
+    // held (never across a co_await) by whichever worker is using the database
+    std::mutex mutex_;
+
+    // an interval of 0 commits as soon as anything is pushed, rather than periodically
+    Journal(unsigned interval);
+
+    // starts the worker, so call this once the subclass (and its statements) are constructed
+    void Open();
+
+    void Pushed() {
+        pushed_.set();
+    }
+
+    template <typename Code_>
+    void Transact(Database &database, Code_ &&code) {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        Statement<None>(database, R"(begin)")();
+        try {
+            code();
+            Statement<None>(database, R"(commit)")();
+        } catch (...) {
+            orc_ignore({ Statement<None>(database, R"(rollback)")(); });
+            throw;
+        }
+    }
+
+    virtual void Commit() = 0;
+
+    // whatever else must be done with the database before the final Commit
+    virtual task<void> Settle() noexcept {
+        co_return;
+    }
+
+  public:
+    task<void> Shut() noexcept override;
+};
+
+}
+
+#endif//ORCHID_JOURNAL_HPP
@@ -0,0 +1,68 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#include "baton.hpp"
+#include "kernel.hpp"
+#include "spread.hpp"
+#include "syncfile.hpp"
+
+namespace orc {
+
+void Kernel(BufferSunk &sunk, const std::string &device, unsigned queues) {
+    orc_assert(queues != 0);
+    orc_assert_(device.size() < IFNAMSIZ, "device name " << device << " is too long");
+
+    auto &spread(sunk.Wire<Spread<SyncFile<asio::posix::stream_descriptor>>>());
+
+    for (unsigned i(0); i != queues; ++i) {
+        // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+        const auto file(open("/dev/net/tun", O_RDWR));
+        orc_assert_(file != -1, "open(/dev/net/tun) failed");
+
+        struct ifreq request = {.ifr_flags = short(IFF_TUN | IFF_NO_PI | (queues == 1 ? 0 : IFF_MULTI_QUEUE))};
+        device.copy(request.ifr_name, IFNAMSIZ - 1);
+
+        // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+        if (ioctl(file, TUNSETIFF, (void *) &request) < 0) {
+            close(file);
+            orc_throw("unable to attach queue " << i << " of " << device);
+        }
+
+        spread.Add(Context(), file);
+    }
+
+    spread.Open();
+}
+
+}
+
+#endif
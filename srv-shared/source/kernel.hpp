@@ -0,0 +1,37 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_KERNEL_HPP
+#define ORCHID_KERNEL_HPP
+
+#include <string>
+
+#include "link.hpp"
+
+namespace orc {
+
+// egress straight into a local TUN device, leaving routing and NAT beyond it to the kernel
+void Kernel(BufferSunk &sunk, const std::string &device, unsigned queues);
+
+}
+
+#endif//ORCHID_KERNEL_HPP
@@ -49,11 +49,14 @@
 #include "coinbase.hpp"
 #include "egress.hpp"
 #include "jsonrpc.hpp"
+#include "kernel.hpp"
 #include "local.hpp"
 #include "node.hpp"
 #include "router.hpp"
 #include "scope.hpp"
 #include "server.hpp"
+#include "snapshot.hpp"
+#include "spool.hpp"
 #include "store.hpp"
 #include "task.hpp"
 #include "transport.hpp"
@@ -93,6 +96,7 @@ int Main(int argc, const char *const argv[]) {
         ("chainid", po::value<unsigned>()->default_value(1), "ropsten = 3; rinkeby = 4; goerli = 5")
         ("rpc", po::value<std::string>()->default_value("http://127.0.0.1:8545/"), "ethereum json/rpc private API endpoint")
         ("ws", po::value<std::string>()->default_value("ws://127.0.0.1:8546/"), "ethereum websocket private API endpoint")
+        ("multiplex", po::bool_switch(), "watch the lottery with one log subscription rather than one per client")
         ("stun", po::value<std::string>()->default_value("stun.l.google.com:19302"), "stun server url to use for discovery")
     ; options.add(group); }
 
@@ -105,6 +109,8 @@ int Main(int argc, const char *const argv[]) {
         ("tls", po::value<std::string>(), "tls keys and chain (pkcs#12 encoded)")
         ("dh", po::value<std::string>(), "diffie hellman params (pem encoded)")
         ("network", po::value<std::string>(), "local interface for ICE candidates")
+        ("udp-batch", po::value<unsigned>()->default_value(32), "datagrams moved per system call on local UDP sockets (1 to disable)")
+        ("udp-offload", po::bool_switch(), "let the kernel segment and coalesce local UDP (GSO/GRO) when it can")
     ; options.add(group); }
 
     { po::options_description group("bandwidth pricing");
@@ -113,10 +119,25 @@ int Main(int argc, const char *const argv[]) {
         ("price", po::value<std::string>()->default_value("0.03"), "price of bandwidth in currency / GB")
     ; options.add(group); }
 
+    { po::options_description group("local state");
+    group.add_options()
+        ("database", po::value<std::string>()->default_value("orchidd.db"), "sqlite file for pending transactions")
+        ("snapshot", po::value<std::string>()->default_value("orchidd.snap"), "sqlite file of prices and balances to serve from while restarting")
+        ("pots", po::value<size_t>()->default_value(100000), "maximum number of client accounts to track")
+        ("pot-idle", po::value<unsigned>()->default_value(60*60), "seconds before an idle client account may be forgotten")
+    ; options.add(group); }
+
     { po::options_description group("packet egress");
     group.add_options()
         ("openvpn", po::value<std::string>(), "OpenVPN .ovpn configuration file")
         ("wireguard", po::value<std::string>(), "WireGuard .conf configuration file")
+#ifdef __linux__
+        ("tun", po::value<std::string>(), "local TUN device to egress through, leaving routing and NAT to the kernel")
+        ("tun-queues", po::value<unsigned>()->default_value(1), "number of queues to open on the TUN device")
+#endif
+        ("egress", po::value<std::vector<std::string>>()->composing(), "address (routed to --tun) to translate client flows to; repeat to spread clients over several (default 0.0.0.0)")
+        ("egress-flows", po::value<size_t>()->default_value(8192), "maximum concurrent flows per client (0 for no limit)")
+        ("egress-rate", po::value<uint32_t>()->default_value(512), "maximum new flows per second per client (0 for no limit)")
     ; options.add(group); }
 
     po::positional_options_description positional;
@@ -211,7 +232,9 @@ int Main(int argc, const char *const argv[]) {
     Address location(args["location"].as<std::string>());
     std::string password(args["password"].as<std::string>());
 
-    auto origin(args.count("network") == 0 ? Break<Local>() : Break<Local>(args["network"].as<std::string>()));
+    const auto batch(args["udp-batch"].as<unsigned>());
+    const auto offload(args["udp-offload"].as<bool>());
+    auto origin(args.count("network") == 0 ? Break<Local>(batch, offload) : Break<Local>(args["network"].as<std::string>(), batch, offload));
 
 
     {
@@ -264,8 +287,8 @@ int Main(int argc, const char *const argv[]) {
     }
 
     auto cashier([&]() -> S<Cashier> {
-        const auto price(Float(args["price"].as<std::string>()) / (1024 * 1024 * 1024));
-        if (price == 0)
+        const Money price(Float(args["price"].as<std::string>()) / (1024 * 1024 * 1024));
+        if (price == Money())
             return nullptr;
 
         orc_assert_(args.count("recipient") != 0, "must specify --recipient unless --price is 0");
@@ -274,45 +297,72 @@ int Main(int argc, const char *const argv[]) {
         // XXX: this should switch to a different mechanism (using eth_sendTransaction)
         const Address personal(args.count("personal") == 0 ? "0x0000000000000000000000000000000000000000" : args["personal"].as<std::string>());
 
+        // with a snapshot these do not block on their first fetch
+        auto snapshot(Break<Snapshot>(args["snapshot"].as<std::string>(), 10*1000));
+
         auto fiat(Update(5*60*1000, [origin, currency = args["currency"].as<std::string>()]() -> task<Fiat> {
             co_return co_await Coinbase(*origin, currency);
-        }));
+        }, snapshot->Rate()));
         Wait(fiat->Open());
 
-        auto gauge(Make<Gauge>(5*60*1000, origin));
+        auto gauge(Make<Gauge>(5*60*1000, origin, snapshot->Prices()));
         Wait(gauge->Open());
 
-        auto cashier(Break<Cashier>(std::move(endpoint), std::move(fiat), std::move(gauge),
-            price, personal, password,
-            Address(args["lottery"].as<std::string>()), args["chainid"].as<unsigned>(), recipient
+        const Address lottery(args["lottery"].as<std::string>());
+        auto spool(Break<Spool>(args["database"].as<std::string>(), std::move(endpoint), personal, password, lottery, 1000));
+
+        auto cashier(Break<Cashier>(std::move(spool), std::move(snapshot), std::move(fiat), std::move(gauge),
+            price, lottery, args["chainid"].as<unsigned>(), recipient,
+            args["multiplex"].as<bool>(), args["pots"].as<size_t>(), args["pot-idle"].as<unsigned>()
         ));
         cashier->Open(origin, Locator::Parse(args["ws"].as<std::string>()));
         return cashier;
     }());
 
+    std::vector<uint32_t> locals;
+    if (args.count("egress") == 0)
+        locals.emplace_back(0);
+    else for (const auto &local : args["egress"].as<std::vector<std::string>>())
+        locals.emplace_back(Host(local));
+    const auto flows(args["egress-flows"].as<size_t>());
+    const auto rate(args["egress-rate"].as<uint32_t>());
+
     auto egress([&]() -> S<Egress> {
         if (false) {
         } else if (args.count("openvpn") != 0) {
+            // the tunnel hands out (and then rewrites to and from) its one address, which Egress sees as 0
+            orc_assert_(args.count("egress") == 0, "--egress only applies to --tun");
             std::string file;
             boost::filesystem::load_string_file(args["openvpn"].as<std::string>(), file);
 
-            return Wait([origin, file = std::move(file)]() mutable -> task<S<Egress>> {
-                auto egress(Make<BufferSink<Egress>>(0));
+            return Wait([origin, file = std::move(file), &locals, flows, rate]() mutable -> task<S<Egress>> {
+                auto egress(Make<BufferSink<Egress>>(locals, flows, rate));
                 co_await Connect(*egress, std::move(origin), 0, file, "", "");
                 co_return egress;
             }());
         } else if (args.count("wireguard") != 0) {
+            orc_assert_(args.count("egress") == 0, "--egress only applies to --tun");
             std::string file;
             boost::filesystem::load_string_file(args["wireguard"].as<std::string>(), file);
 
-            return Wait([origin, file = std::move(file)]() mutable -> task<S<Egress>> {
-                auto egress(Make<BufferSink<Egress>>(0));
+            return Wait([origin, file = std::move(file), &locals, flows, rate]() mutable -> task<S<Egress>> {
+                auto egress(Make<BufferSink<Egress>>(locals, flows, rate));
                 co_await Guard(*egress, std::move(origin), 0, file);
                 co_return egress;
             }());
+#ifdef __linux__
+        } else if (args.count("tun") != 0) {
+            // the kernel only routes replies back to us if flows leave from an address it assigns to the device
+            orc_assert_(args.count("egress") != 0, "--tun requires --egress with an address routed to the device");
+            auto egress(Make<BufferSink<Egress>>(locals, flows, rate));
+            Kernel(*egress, args["tun"].as<std::string>(), args["tun-queues"].as<unsigned>());
+            return egress;
+#endif
         } else orc_assert_(false, "must provide an egress option");
     }());
 
+    egress->Open();
+
     const auto node(Make<Node>(std::move(origin), std::move(cashier), std::move(egress), std::move(ice)));
     node->Run(path, asio::ip::make_address(args["bind"].as<std::string>()), port, store.Key(), store.Chain(), params);
     return 0;
@@ -53,6 +53,14 @@ void Node::Run(const std::string &path, const asio::ip::address &bind, uint16_t
         co_return Respond(request, http::status::ok, "text/plain", std::move(answer));
     });
 
+    router(http::verb::get, "/metrics", [&](Request request) -> task<Response> {
+        std::ostringstream body;
+        if (cashier_ != nullptr)
+            cashier_->Metrics(body);
+        egress_->Metrics(body);
+        co_return Respond(request, http::status::ok, "text/plain", body.str());
+    });
+
     router.Run(bind, port, key, chain, params);
     Thread().join();
 }
@@ -0,0 +1,88 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_PORTS_HPP
+#define ORCHID_PORTS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace orc {
+
+// the slots behind one shard's slice of ports: free ones are handed out from a list, and once that runs
+// dry a second-chance clock hand picks who gives one up (Slot_ has an atomic used_, which traffic sets)
+template <typename Slot_>
+class Ports {
+  private:
+    std::vector<Slot_> slots_;
+    std::vector<uint16_t> free_;
+    size_t hand_ = 0;
+
+  public:
+    Ports(size_t size) :
+        slots_(size)
+    {
+        for (auto slot(size); slot != 0; --slot)
+            free_.emplace_back(slot - 1);
+    }
+
+    size_t size() const {
+        return slots_.size();
+    }
+
+    Slot_ &operator [](uint16_t index) {
+        return slots_[index];
+    }
+
+    bool Full() const {
+        return free_.empty();
+    }
+
+    uint16_t Take() {
+        const auto index(free_.back());
+        free_.pop_back();
+        return index;
+    }
+
+    void Free(uint16_t index) {
+        slots_[index].used_.store(false, std::memory_order_relaxed);
+        free_.emplace_back(index);
+    }
+
+    // only once Full: anything touched since the hand last passed it survives one more lap, unless heavy
+    // says its owner is who should pay; the slot is not freed, as its owner has to be told first
+    template <typename Heavy_>
+    uint16_t Victim(const Heavy_ &heavy) {
+        for (;; hand_ = (hand_ + 1) % slots_.size()) {
+            auto &slot(slots_[hand_]);
+            if (slot.used_.exchange(false, std::memory_order_relaxed) && !heavy(slot))
+                continue;
+            const uint16_t index(hand_);
+            hand_ = (hand_ + 1) % slots_.size();
+            return index;
+        }
+    }
+};
+
+}
+
+#endif//ORCHID_PORTS_HPP
@@ -0,0 +1,84 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <algorithm>
+
+#include "gauge.hpp"
+#include "rates.hpp"
+
+namespace orc {
+
+Rates::Rates(const std::map<unsigned, double> &prices, const Fiat &fiat) :
+    oxt_(fiat.oxt_)
+{
+    const Money eth(fiat.eth_);
+    for (const auto &[price, time] : prices) {
+        const auto cost(price * Gwei / 10);
+        points_.push_back({unsigned(time), cost, eth * cost});
+    }
+
+    for (size_t i(0); i != points_.size(); ++i)
+        deadlines_.emplace_back(points_[i].time_, i);
+    std::stable_sort(deadlines_.begin(), deadlines_.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    for (size_t i(1); i < deadlines_.size(); ++i)
+        deadlines_[i].second = std::min(deadlines_[i].second, deadlines_[i - 1].second);
+}
+
+std::pair<Money, uint256_t> Rates::Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const {
+    const auto base(oxt_ * uint256_t(amount));
+    const auto until(start + range);
+
+    std::pair<Money, uint256_t> credit(Money(), 10*Gwei);
+    if (until <= now)
+        return credit;
+
+    const auto last(std::lower_bound(deadlines_.begin(), deadlines_.end(), until - now, [](const auto &deadline, const uint256_t &limit) {
+        return deadline.first < limit;
+    }));
+    if (last == deadlines_.begin())
+        return credit;
+
+    // if even the slowest usable point lands before start there is no decay, so the cheapest usable point wins
+    const auto &[time, index] = *(last - 1);
+    if (now + time <= start) {
+        const auto &point(points_[index]);
+        const auto profit(base - point.fee_ * gas);
+        if (profit > std::get<0>(credit))
+            credit = {profit, point.cost_};
+        return credit;
+    }
+
+    for (const auto &point : points_) {
+        const auto when(now + point.time_);
+        if (when >= until) continue;
+        const auto profit((start < when ? base.Scale(range - (when - start), range) : base) - point.fee_ * gas);
+        if (profit > std::get<0>(credit))
+            credit = {profit, point.cost_};
+    }
+
+    return credit;
+}
+
+}
@@ -0,0 +1,61 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_RATES_HPP
+#define ORCHID_RATES_HPP
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "fiat.hpp"
+#include "integer.hpp"
+#include "money.hpp"
+
+namespace orc {
+
+// everything Cashier::Credit needs that only changes when the gauge or the fiat updater refreshes
+class Rates {
+  private:
+    struct Point_ {
+        unsigned time_;
+        uint256_t cost_;
+        Money fee_;
+    };
+
+    // in gauge order (by increasing price)
+    std::vector<Point_> points_;
+    // by increasing time, each paired with the cheapest point at least that fast
+    std::vector<std::pair<unsigned, size_t>> deadlines_;
+
+  public:
+    const Money oxt_;
+
+    Rates(const std::map<unsigned, double> &prices, const Fiat &fiat);
+
+    // the best expected value of a ticket (after paying gas to claim it), and the gas price that gets it
+    std::pair<Money, uint256_t> Credit(const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) const;
+};
+
+}
+
+#endif//ORCHID_RATES_HPP
@@ -0,0 +1,112 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_RECENT_HPP
+#define ORCHID_RECENT_HPP
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include "error.hpp"
+
+namespace orc {
+
+// a map that remembers the order its entries were last used in, so the coldest (and any left idle) can be let go
+template <typename Key_, typename Value_, typename Hash_ = std::hash<Key_>>
+class Recent {
+  public:
+    typedef std::chrono::steady_clock::time_point Time;
+
+  private:
+    typedef std::list<Key_> Order_;
+
+    struct Entry_ {
+        Value_ value_;
+        typename Order_::iterator recent_;
+        Time used_;
+    };
+
+    std::unordered_map<Key_, Entry_, Hash_> entries_;
+    // most recently used first
+    Order_ order_;
+
+  public:
+    size_t size() const {
+        return entries_.size();
+    }
+
+    Value_ *Find(const Key_ &key) {
+        const auto entry(entries_.find(key));
+        return entry == entries_.end() ? nullptr : &entry->second.value_;
+    }
+
+    // marks key as used now, adding it (and saying so) if it was not there
+    std::pair<Value_ &, bool> Touch(const Key_ &key, Time now) {
+        const auto [entry, inserted] = entries_.try_emplace(key);
+        auto &value(entry->second);
+        value.used_ = now;
+        if (!inserted)
+            order_.splice(order_.begin(), order_, value.recent_);
+        else {
+            order_.emplace_front(entry->first);
+            value.recent_ = order_.begin();
+        }
+        return {value.value_, inserted};
+    }
+
+    // adds key as less recently used than everything already here, for loading a list kept hottest first
+    Value_ &Append(const Key_ &key, Time used) {
+        const auto [entry, inserted] = entries_.try_emplace(key);
+        orc_insist(inserted);
+        auto &value(entry->second);
+        value.used_ = used;
+        order_.emplace_back(entry->first);
+        value.recent_ = std::prev(order_.end());
+        return value.value_;
+    }
+
+    // from the cold end, while there are more than maximum entries or the coldest has been idle that long;
+    // code is shown each one and returns false to keep it (and move on to the next)
+    template <typename Code_>
+    void Evict(size_t maximum, std::chrono::steady_clock::duration idle, Time now, Code_ &&code) {
+        for (auto recent(order_.rbegin()); recent != order_.rend(); ) {
+            const auto entry(entries_.find(*recent));
+            orc_insist(entry != entries_.end());
+            if (entries_.size() <= maximum && now - entry->second.used_ < idle)
+                break;
+
+            if (!code(entry->first, entry->second.value_)) {
+                ++recent;
+                continue;
+            }
+
+            entries_.erase(entry);
+            recent = decltype(recent)(order_.erase(std::next(recent).base()));
+        }
+    }
+};
+
+}
+
+#endif//ORCHID_RECENT_HPP
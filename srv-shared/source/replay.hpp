@@ -0,0 +1,155 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_REPLAY_HPP
+#define ORCHID_REPLAY_HPP
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "crypto.hpp"
+#include "jsonrpc.hpp"
+
+namespace orc {
+
+// remembers the last horizon tickets by (issued, nonce, signer); anything older than the window is refused outright
+class Replay {
+  private:
+    typedef std::tuple<uint256_t, Bytes32, Address> Key_;
+
+    // every part of the key is up to the client, so all of it goes through the keyed hash
+    struct Hash_ {
+        size_t operator ()(const Key_ &key) const noexcept {
+            const Number<uint256_t> issued(std::get<0>(key));
+            const Number<uint160_t> signer(std::get<2>(key));
+            std::array<uint8_t, 32 + 32 + 20> data;
+            memcpy(data.data(), issued.data(), 32);
+            memcpy(data.data() + 32, std::get<1>(key).data(), 32);
+            memcpy(data.data() + 64, signer.data(), 20);
+            return SipHash(data.data(), data.size());
+        }
+    };
+
+    struct Bucket_ {
+        uint256_t issued_;
+        std::vector<Key_> keys_;
+    };
+
+    const size_t horizon_;
+    uint256_t floor_ = 0;
+
+    std::unordered_set<Key_, Hash_> seen_;
+    // tickets are almost always issued in order, so new buckets are nearly always appended
+    std::deque<Bucket_> buckets_;
+
+  public:
+    Replay(size_t horizon) :
+        horizon_(horizon)
+    {
+        seen_.reserve(horizon_ + 1);
+    }
+
+    bool operator ()(const uint256_t &issued, const Bytes32 &nonce, const Address &signer) {
+        if (issued < floor_)
+            return false;
+
+        Key_ key(issued, nonce, signer);
+        if (!seen_.emplace(key).second)
+            return false;
+
+        if (buckets_.empty() || buckets_.back().issued_ < issued)
+            buckets_.push_back({issued, {std::move(key)}});
+        else {
+            const auto bucket(std::lower_bound(buckets_.begin(), buckets_.end(), issued, [](const Bucket_ &bucket, const uint256_t &issued) {
+                return bucket.issued_ < issued;
+            }));
+
+            if (bucket->issued_ == issued)
+                bucket->keys_.emplace_back(std::move(key));
+            else
+                buckets_.insert(bucket, {issued, {std::move(key)}});
+        }
+
+        // everything sharing the oldest timestamp falls off together, as it would no longer be admitted anyway
+        while (seen_.size() > horizon_) {
+            auto &oldest(buckets_.front());
+            floor_ = oldest.issued_ + 1;
+            for (const auto &key : oldest.keys_)
+                seen_.erase(key);
+            buckets_.pop_front();
+        }
+
+        return true;
+    }
+
+    size_t size() const {
+        return seen_.size();
+    }
+};
+
+// the reveal behind every commit handed out; a replaced commit still pays out for a minute, and is then forgotten
+class Reveals {
+  private:
+    std::unordered_map<Bytes32, std::pair<Bytes32, uint256_t>, Keyed> reveals_;
+    Bytes32 commit_ = Zero<32>();
+
+  public:
+    const Bytes32 &Current() const {
+        return commit_;
+    }
+
+    void Commit(const Bytes32 &commit, const Bytes32 &reveal, const uint256_t &now) {
+        const auto current(reveals_.find(commit_));
+        if (current != reveals_.end())
+            current->second.second = now;
+
+        // Submit refuses reveals that expired over a minute ago, so there is no point keeping them
+        for (auto old(reveals_.begin()); old != reveals_.end(); )
+            if (old->second.second != 0 && old->second.second + 60 <= now)
+                old = reveals_.erase(old);
+            else
+                ++old;
+
+        commit_ = commit;
+        orc_insist(reveals_.try_emplace(commit_, reveal, 0).second);
+    }
+
+    Bytes32 operator ()(const Bytes32 &commit, const uint256_t &now) const {
+        const auto reveal(reveals_.find(commit));
+        orc_assert(reveal != reveals_.end());
+        const auto expire(reveal->second.second);
+        orc_assert(expire == 0 || expire + 60 > now);
+        return reveal->second.first;
+    }
+
+    size_t size() const {
+        return reveals_.size();
+    }
+};
+
+}
+
+#endif//ORCHID_REPLAY_HPP
@@ -122,19 +122,17 @@ task<void> Server::Send(const Buffer &data) {
 
 void Server::Commit(const Lock<Locked_> &locked) {
     const auto reveal(Random<32>());
-    if (locked->commit_ != locked->reveals_.end())
-        locked->commit_->second.second = Timestamp();
-    locked->commit_ = locked->reveals_.try_emplace(Hash(reveal), reveal, 0).first;
+    locked->reveals_.Commit(Hash(reveal), reveal, Timestamp());
 }
 
-Float Server::Expected(const Lock<Locked_> &locked) {
+Money Server::Expected(const Lock<Locked_> &locked) {
     auto balance(locked->balance_);
     for (const auto &expected : locked->expected_)
         balance += expected.second;
     return balance;
 }
 
-task<void> Server::Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Float &balance, const Bytes32 &commit) {
+task<void> Server::Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Money &balance, const Bytes32 &commit) {
     Header header{Magic_, id};
     co_await Send(pipe, Datagram(Port_, destination, Tie(header,
         Command(Stamp_, Monotonic()),
@@ -144,7 +142,7 @@ task<void> Server::Invoice(Pipe<Buffer> &pipe, const Socket &destination, const
 
 task<void> Server::Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id) {
     const auto [serial, balance, commit] = [&]() { const auto locked(locked_());
-        return std::make_tuple(locked->serial_, Expected(locked), locked->commit_->first); }();
+        return std::make_tuple(locked->serial_, Expected(locked), locked->reveals_.Current()); }();
     co_await Invoice(pipe, destination, id, serial, balance, commit);
 }
 
@@ -178,10 +176,9 @@ void Server::Submit(Pipe<Buffer> *pipe, const Socket &source, const Bytes32 &id,
 
     const uint256_t gas(100000);
     const auto [profit, price] = cashier_->Credit(now, start, range, amount, gas);
-    if (profit <= 0)
+    if (profit <= Money())
         return;
-    static const Float Two128(uint256_t(1) << 128);
-    const auto expected(profit * Float(ratio + 1) / Two128);
+    const auto expected(profit.Scale(uint256_t(ratio) + 1, uint256_t(1) << 128));
 
     using Ticket = Coder<Bytes32, Bytes32, uint256_t, Bytes32, Address, uint256_t, uint128_t, uint128_t, uint256_t, uint128_t, Address, Address, Bytes>;
     static const auto orchid(Hash("Orchid.grab"));
@@ -191,30 +188,16 @@ void Server::Submit(Pipe<Buffer> *pipe, const Socket &source, const Bytes32 &id,
     const auto [reveal, winner] = [&, commit = commit, issued = issued, nonce = nonce, ratio = ratio, expected = expected] {
         const auto locked(locked_());
 
-        orc_assert(issued >= locked->issued_);
-        auto &nonces(locked->nonces_);
-        orc_assert(nonces.emplace(issued, nonce, signer).second);
-        while (nonces.size() > horizon_) {
-            const auto oldest(nonces.begin());
-            orc_assert(oldest != nonces.end());
-            locked->issued_ = std::get<0>(*oldest) + 1;
-            nonces.erase(oldest);
-        }
+        orc_assert(locked->nonces_(issued, nonce, signer));
 
-        const auto reveal([&]() {
-            const auto reveal(locked->reveals_.find(commit));
-            orc_assert(reveal != locked->reveals_.end());
-            const auto expire(reveal->second.second);
-            orc_assert(expire == 0 || reveal->second.second + 60 > now);
-            return reveal->second.first;
-        }());
+        const auto reveal(locked->reveals_(commit, now));
 
         orc_assert(locked->expected_.emplace(ticket, expected).second);
         ++locked->serial_;
 
         // NOLINTNEXTLINE (clang-analyzer-core.UndefinedBinaryOperatorResult)
         const auto winner(Hash(Tie(reveal, issued, nonce)).skip<16>().num<uint128_t>() <= ratio);
-        if (winner && locked->commit_->first == commit)
+        if (winner && locked->reveals_.Current() == commit)
             Commit(locked);
 
         return std::make_tuple(reveal, winner);
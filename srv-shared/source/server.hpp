@@ -24,15 +24,18 @@
 #define ORCHID_SERVER_HPP
 
 #include <map>
-#include <set>
+#include <unordered_map>
 
 #include <rtc_base/rtc_certificate.h>
 
 #include "bond.hpp"
+#include "crypto.hpp"
 #include "jsonrpc.hpp"
 #include "link.hpp"
 #include "locked.hpp"
+#include "money.hpp"
 #include "nest.hpp"
+#include "replay.hpp"
 #include "shared.hpp"
 #include "task.hpp"
 
@@ -60,14 +63,11 @@ class Server :
 
     struct Locked_ {
         uint64_t serial_ = 0;
-        Float balance_ = 0;
-        std::map<Bytes32, Float> expected_;
+        Money balance_;
+        std::unordered_map<Bytes32, Money, Keyed> expected_;
 
-        std::map<Bytes32, std::pair<Bytes32, uint256_t>> reveals_;
-        decltype(reveals_.end()) commit_ = reveals_.end();
-
-        uint256_t issued_ = 0;
-        std::set<std::tuple<uint256_t, Bytes32, Address>> nonces_;
+        Reveals reveals_;
+        Replay nonces_{horizon_};
     }; Locked<Locked_> locked_;
 
     bool Bill(const Buffer &data, bool force);
@@ -78,9 +78,9 @@ class Server :
     task<void> Send(const Buffer &data) override;
 
     void Commit(const Lock<Locked_> &locked);
-    Float Expected(const Lock<Locked_> &locked);
+    Money Expected(const Lock<Locked_> &locked);
 
-    task<void> Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Float &balance, const Bytes32 &commit);
+    task<void> Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id, uint64_t serial, const Money &balance, const Bytes32 &commit);
     task<void> Invoice(Pipe<Buffer> &pipe, const Socket &destination, const Bytes32 &id = Zero<32>());
 
     void Submit(Pipe<Buffer> *pipe, const Socket &source, const Bytes32 &id, const Buffer &data);
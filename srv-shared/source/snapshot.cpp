@@ -0,0 +1,204 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include "jsonrpc.hpp"
+#include "snapshot.hpp"
+
+namespace orc {
+
+Snapshot::Database_::Database_(const std::string &path) :
+    Database(path)
+{
+    Statement<Skip>(*this, R"(pragma journal_mode = wal)")();
+    // a snapshot is only a hint: losing the tail of it just means refetching those values
+    Statement<None>(*this, R"(pragma synchronous = normal)")();
+
+    Statement<None>(*this, R"(begin)")();
+
+    const auto version(std::get<0>(Statement<One<int32_t>>(*this, R"(pragma user_version)")()));
+    switch (version) {
+        case 0:
+            Statement<None>(*this, R"(
+                create table "fiat" (
+                    "id" integer primary key check ("id" = 0),
+                    "eth" text not null,
+                    "oxt" text not null
+                )
+            )")();
+
+            Statement<None>(*this, R"(
+                create table "gauge" (
+                    "price" integer primary key,
+                    "time" real not null
+                )
+            )")();
+
+            Statement<None>(*this, R"(
+                create table "pot" (
+                    "identity" blob primary key,
+                    "amount" text not null,
+                    "escrow" text not null,
+                    "unlock" text not null,
+                    "updated" integer not null
+                )
+            )")();
+
+            Statement<None>(*this, R"(
+                create index "pot_updated" on "pot" ("updated")
+            )")();
+        case 1:
+            break;
+        default:
+            orc_assert(false);
+    }
+
+    Statement<None>(*this, R"(pragma user_version = 1)")();
+    Statement<None>(*this, R"(commit)")();
+}
+
+void Snapshot::Commit() {
+    std::optional<Fiat> fiat;
+    S<Gauge::Prices_> prices;
+    std::map<Identity, Balance> pots;
+    { const auto locked(locked_());
+        std::swap(fiat, locked->fiat_);
+        std::swap(prices, locked->prices_);
+        std::swap(pots, locked->pots_); }
+
+    if (!fiat && prices == nullptr && pots.empty())
+        return;
+
+    const auto now(Timestamp().convert_to<sqlite3_int64>());
+    try {
+        Transact(database_, [&]() {
+            if (fiat)
+                fiat_(fiat->eth_.str(), fiat->oxt_.str());
+            if (prices != nullptr) {
+                clear_();
+                for (const auto &[price, time] : *prices)
+                    price_(price, time);
+            }
+            for (const auto &[identity, balance] : pots)
+                pot_(Beam(Tie(std::get<0>(identity), std::get<1>(identity))), balance.amount_.str(), balance.escrow_.str(), balance.unlock_.str(), now);
+        });
+    } catch (...) {
+        // keep these for the next pass, except where something newer was pushed in the meantime
+        const auto locked(locked_());
+        if (!locked->fiat_)
+            locked->fiat_ = fiat;
+        if (locked->prices_ == nullptr)
+            locked->prices_ = prices;
+        for (const auto &[identity, balance] : pots)
+            locked->pots_.try_emplace(identity, balance);
+        throw;
+    }
+}
+
+Snapshot::Snapshot(const std::string &path, unsigned interval) :
+    Journal(interval),
+
+    database_(path),
+    fiat_(database_, R"(
+        insert or replace into "fiat" (
+            "id", "eth", "oxt"
+        ) values (
+            0, ?, ?
+        )
+    )"),
+    clear_(database_, R"(
+        delete from "gauge"
+    )"),
+    price_(database_, R"(
+        insert into "gauge" (
+            "price", "time"
+        ) values (
+            ?, ?
+        )
+    )"),
+    pot_(database_, R"(
+        insert or replace into "pot" (
+            "identity", "amount", "escrow", "unlock", "updated"
+        ) values (
+            ?, ?, ?, ?, ?
+        )
+    )")
+{
+    type_ = typeid(*this).name();
+
+    Open();
+}
+
+std::optional<Fiat> Snapshot::Rate() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto rows(Statement<Rows<std::string, std::string>>(database_, R"(
+        select "eth", "oxt" from "fiat"
+    )")());
+    if (rows.empty())
+        return std::nullopt;
+    const auto &[eth, oxt] = rows[0];
+    return Fiat{Float(eth), Float(oxt)};
+}
+
+S<Gauge::Prices_> Snapshot::Prices() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto rows(Statement<Rows<sqlite3_int64, double>>(database_, R"(
+        select "price", "time" from "gauge"
+    )")());
+    if (rows.empty())
+        return nullptr;
+    auto prices(Make<Gauge::Prices_>());
+    for (const auto &[price, time] : rows)
+        prices->emplace(unsigned(price), time);
+    return prices;
+}
+
+std::vector<std::tuple<Identity, Balance>> Snapshot::Pots(size_t limit) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    // only the most recently active pots are worth holding; the rest would just be evicted again
+    Statement<None, sqlite3_int64>(database_, R"(
+        delete from "pot" where "identity" not in (
+            select "identity" from "pot" order by "updated" desc limit ?
+        )
+    )")(sqlite3_int64(limit));
+
+    std::vector<std::tuple<Identity, Balance>> pots;
+    for (const auto &[identity, amount, escrow, unlock] : Statement<Rows<Beam, std::string, std::string, std::string>>(database_, R"(
+        select "identity", "amount", "escrow", "unlock" from "pot" order by "updated" desc
+    )")())
+        pots.emplace_back(Take<Address, Address>(identity), Balance{uint128_t(amount), uint128_t(escrow), uint256_t(unlock)});
+    return pots;
+}
+
+void Snapshot::Push(const Fiat &fiat) {
+    locked_()->fiat_ = fiat;
+}
+
+void Snapshot::Push(S<Gauge::Prices_> prices) {
+    locked_()->prices_ = std::move(prices);
+}
+
+void Snapshot::Push(const Identity &identity, const Balance &balance) {
+    locked_()->pots_[identity] = balance;
+}
+
+}
@@ -0,0 +1,87 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SNAPSHOT_HPP
+#define ORCHID_SNAPSHOT_HPP
+
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "database.hpp"
+#include "fiat.hpp"
+#include "gauge.hpp"
+#include "journal.hpp"
+#include "jsonrpc.hpp"
+#include "locked.hpp"
+
+namespace orc {
+
+typedef std::tuple<Address, Address> Identity;
+
+struct Balance {
+    uint128_t amount_ = 0;
+    uint128_t escrow_ = 0;
+    uint256_t unlock_ = 0;
+};
+
+// the last known prices and pot states, so a restart can serve immediately while the real values are refetched
+class Snapshot :
+    public Journal
+{
+  private:
+    class Database_ :
+        public Database
+    {
+      public:
+        Database_(const std::string &path);
+    };
+
+    Database_ database_;
+    Statement<None, std::string, std::string> fiat_;
+    Statement<None> clear_;
+    Statement<None, sqlite3_int64, double> price_;
+    Statement<None, Beam, std::string, std::string, std::string, sqlite3_int64> pot_;
+
+    struct Locked_ {
+        std::optional<Fiat> fiat_;
+        S<Gauge::Prices_> prices_;
+        std::map<Identity, Balance> pots_;
+    }; Locked<Locked_> locked_;
+
+    void Commit() override;
+
+  public:
+    Snapshot(const std::string &path, unsigned interval);
+
+    std::optional<Fiat> Rate();
+    S<Gauge::Prices_> Prices();
+    std::vector<std::tuple<Identity, Balance>> Pots(size_t limit);
+
+    void Push(const Fiat &fiat);
+    void Push(S<Gauge::Prices_> prices);
+    void Push(const Identity &identity, const Balance &balance);
+};
+
+}
+
+#endif//ORCHID_SNAPSHOT_HPP
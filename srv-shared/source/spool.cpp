@@ -0,0 +1,158 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include "sleep.hpp"
+#include "spawn.hpp"
+#include "spool.hpp"
+
+namespace orc {
+
+Spool::Database_::Database_(const std::string &path) :
+    Database(path)
+{
+    Statement<Skip>(*this, R"(pragma journal_mode = wal)")();
+    Statement<None>(*this, R"(pragma synchronous = full)")();
+
+    Statement<None>(*this, R"(begin)")();
+
+    const auto version(std::get<0>(Statement<One<int32_t>>(*this, R"(pragma user_version)")()));
+    switch (version) {
+        case 0:
+            Statement<None>(*this, R"(
+                create table "grab" (
+                    "id" integer primary key autoincrement,
+                    "gas" text not null,
+                    "price" text not null,
+                    "data" blob not null,
+                    "retry" integer not null default 0
+                )
+            )")();
+        case 1:
+            break;
+        default:
+            orc_assert(false);
+    }
+
+    Statement<None>(*this, R"(pragma user_version = 1)")();
+    Statement<None>(*this, R"(commit)")();
+}
+
+void Spool::Commit() {
+    // group commit: everything pushed since the last pass shares one fsync (and these are real money, so a failure keeps them)
+    pending_.Take([&](const std::vector<Pending_> &pending) {
+        Transact(database_, [&]() {
+            for (const auto &grab : pending)
+                insert_(grab.gas_.str(), grab.price_.str(), grab.data_);
+        });
+    });
+}
+
+task<void> Spool::Settle() noexcept {
+    // the submitter might still be using the database
+    co_await *submitted_;
+}
+
+task<void> Spool::Drain() noexcept {
+    while (!stopping_) {
+        orc_ignore({
+            const auto now(Timestamp().convert_to<sqlite3_int64>());
+            const auto rows([&]() {
+                const std::lock_guard<std::mutex> lock(mutex_);
+                return next_(now);
+            }());
+
+            if (!rows.empty()) {
+                const auto &[id, gas, price, data] = rows[0];
+                const auto submitted(co_await Submit(uint256_t(gas), uint256_t(price), data));
+                const std::lock_guard<std::mutex> lock(mutex_);
+                if (submitted)
+                    remove_(id);
+                else
+                    delay_(now + 60, id);
+            }
+        });
+
+        co_await Sleep(interval_);
+    }
+
+    submitted_();
+}
+
+task<bool> Spool::Submit(const uint256_t &gas, const uint256_t &price, const Buffer &data) {
+    co_return !orc_ignore({
+        co_await endpoint_("personal_sendTransaction", {Map{
+            {"from", personal_},
+            {"to", lottery_},
+            {"gas", gas},
+            {"gasPrice", price},
+            {"data", data},
+        }, password_});
+    });
+}
+
+Spool::Spool(const std::string &path, Endpoint endpoint, const Address &personal, std::string password, const Address &lottery, unsigned interval) :
+    Journal(0),
+
+    endpoint_(std::move(endpoint)),
+    personal_(personal),
+    password_(std::move(password)),
+    lottery_(lottery),
+    interval_(interval),
+
+    database_(path),
+    insert_(database_, R"(
+        insert into "grab" (
+            "gas", "price", "data"
+        ) values (
+            ?, ?, ?
+        )
+    )"),
+    next_(database_, R"(
+        select "id", "gas", "price", "data" from "grab" where
+            "retry" <= ?
+        order by "retry", "id" limit 1
+    )"),
+    remove_(database_, R"(
+        delete from "grab" where
+            "id" = ?
+    )"),
+    delay_(database_, R"(
+        update "grab" set
+            "retry" = ?
+        where
+            "id" = ?
+    )")
+{
+    type_ = typeid(*this).name();
+
+    // grabs are written to disk as soon as they arrive, independent of a single worker
+    // that drains the spool (including anything left over from a previous run) at a bounded rate
+    Open();
+    Spawn([this]() noexcept { return Drain(); });
+}
+
+void Spool::Push(const uint256_t &gas, const uint256_t &price, Beam data) {
+    pending_.Push(Pending_{gas, price, std::move(data)});
+    Pushed();
+}
+
+}
@@ -0,0 +1,82 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_SPOOL_HPP
+#define ORCHID_SPOOL_HPP
+
+#include <vector>
+
+#include "database.hpp"
+#include "endpoint.hpp"
+#include "event.hpp"
+#include "journal.hpp"
+
+namespace orc {
+
+// pending transactions are worth "real money", so they are kept on disk until they are accepted
+class Spool :
+    public Journal
+{
+  private:
+    const Endpoint endpoint_;
+    const Address personal_;
+    const std::string password_;
+    const Address lottery_;
+    const unsigned interval_;
+
+    class Database_ :
+        public Database
+    {
+      public:
+        Database_(const std::string &path);
+    };
+
+    Database_ database_;
+    Statement<None, std::string, std::string, Beam> insert_;
+    Statement<Rows<sqlite3_int64, std::string, std::string, Beam>, sqlite3_int64> next_;
+    Statement<None, sqlite3_int64> remove_;
+    Statement<None, sqlite3_int64, sqlite3_int64> delay_;
+
+    struct Pending_ {
+        uint256_t gas_;
+        uint256_t price_;
+        Beam data_;
+    };
+
+    Batch<Pending_> pending_;
+
+    Event submitted_;
+
+    void Commit() override;
+    task<void> Settle() noexcept override;
+    task<void> Drain() noexcept;
+    task<bool> Submit(const uint256_t &gas, const uint256_t &price, const Buffer &data);
+
+  public:
+    Spool(const std::string &path, Endpoint endpoint, const Address &personal, std::string password, const Address &lottery, unsigned interval);
+
+    void Push(const uint256_t &gas, const uint256_t &price, Beam data);
+};
+
+}
+
+#endif//ORCHID_SPOOL_HPP
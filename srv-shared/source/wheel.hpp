@@ -0,0 +1,76 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_WHEEL_HPP
+#define ORCHID_WHEEL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace orc {
+
+// deadlines (in seconds) filed into buckets each tick_ wide and checked lazily as time passes them; each entry
+// carries the generation of its slot when it was filed, so stale ones for a slot reused since can be told apart
+class Wheel {
+  private:
+    const uint32_t tick_;
+    std::vector<std::vector<std::pair<uint16_t, uint32_t>>> buckets_;
+    uint32_t last_ = 0;
+
+  public:
+    Wheel(uint32_t tick, size_t size) :
+        tick_(tick),
+        buckets_(size)
+    {
+    }
+
+    void File(uint16_t index, uint32_t generation, uint32_t when) {
+        // a deadline past the end of the wheel just gets looked at (and filed again) once per lap
+        const auto tick(std::max(when / tick_, last_ + 1));
+        buckets_[tick % buckets_.size()].emplace_back(index, generation);
+    }
+
+    // code(index, generation) sees everything filed for a tick up to now, and returns when to look again (0 for never)
+    template <typename Code_>
+    void Turn(uint32_t now, const Code_ &code) {
+        // after a long stall there is no point going around more than once
+        const auto last(now / tick_);
+        if (last - last_ > buckets_.size())
+            last_ = last - buckets_.size();
+
+        while (last_ != last) {
+            ++last_;
+            auto &current(buckets_[last_ % buckets_.size()]);
+            auto bucket(std::move(current));
+            current.clear();
+
+            for (const auto &[index, generation] : bucket)
+                if (const auto when = code(index, generation); when != 0)
+                    File(index, generation, when);
+        }
+    }
+};
+
+}
+
+#endif//ORCHID_WHEEL_HPP
@@ -0,0 +1,133 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+#include <iostream>
+#include <random>
+
+#include "float.hpp"
+#include "integer.hpp"
+#include "money.hpp"
+
+namespace orc {
+
+// Money replaced Float in billing: everything here is checked against the Float arithmetic it replaced
+
+static const Float Unit_("1e-30");
+static const Float Two128_(uint256_t(1) << 128);
+
+static uint64_t checks_(0);
+static uint64_t failures_(0);
+
+static void Check(const char *name, const Float &actual, const Float &expected, const Float &bound) {
+    ++checks_;
+    if (abs(actual - expected) <= bound)
+        return;
+    if (++failures_ <= 16)
+        std::cerr << name << ": " << actual << " != " << expected << " +/- " << bound << std::endl;
+}
+
+// a positive value with 18 significant digits, somewhere between 10^low and 10^high
+static Float Random(std::mt19937_64 &random, int low, int high) {
+    std::uniform_int_distribution<uint64_t> mantissa(100000000000000000, 999999999999999999);
+    std::uniform_int_distribution<int> exponent(low, high);
+    return Float(mantissa(random)) * pow(Float(10), exponent(random) - 17);
+}
+
+// Cashier::Bill: price * size
+static void Bill(const Float &price, size_t size) {
+    const auto expected(price * size);
+    const auto actual(Float(Money(price) * size));
+    // the price rounds to half a unit, which then gets multiplied
+    Check("bill", actual, expected, Unit_ * (Float(size) / 2 + 1));
+}
+
+// Cashier::Convert: balance / oxt * 2^128
+static void Convert(const Float &balance, const Float &oxt) {
+    const auto expected(balance / oxt * Two128_);
+    const auto actual(Money(balance).Divide(Money(oxt), 128));
+    // both operands round to half a unit, and then the quotient truncates
+    auto error(Unit_ / abs(oxt));
+    if (balance != 0)
+        error += Unit_ / abs(balance);
+    Check("convert", Float(actual), expected, abs(expected) * error + 2);
+}
+
+// Cashier::Credit: base * (range - elapsed) / range
+static void Scale(const Float &base, const uint256_t &numerator, const uint256_t &denominator) {
+    const auto expected(base * Float(numerator) / Float(denominator));
+    const auto actual(Float(Money(base).Scale(numerator, denominator)));
+    Check("scale", actual, expected, Unit_ * 2);
+}
+
+// Cashier::Credit: eth * cost * gas
+static void Fee(const Float &eth, const uint256_t &cost, const uint256_t &gas) {
+    const auto expected(eth * Float(cost) * Float(gas));
+    const auto actual(Float(Money(eth) * cost * gas));
+    Check("fee", actual, expected, Unit_ * (Float(cost) * Float(gas) / 2 + 1));
+}
+
+int Main(int argc, const char *const argv[]) {
+    orc_assert(argc <= 3);
+    const unsigned count(argc > 1 ? std::stoul(argv[1]) : 10000);
+    std::mt19937_64 random(argc > 2 ? std::stoull(argv[2]) : 0);
+
+    // boundaries: nothing, single units, half units (which round), and the largest representable amounts
+    const std::vector<Float> amounts({Float(0), Unit_, Unit_ / 2, Unit_ * 3 / 2, Float("0.000000001"), Float(1), Float("100000000"), Float("170141183")});
+    const std::vector<size_t> sizes({0, 1, 1500, 65535, 1024 * 1024});
+
+    for (const auto &amount : amounts) {
+        for (const auto size : sizes)
+            if (amount * size < Float("170141183"))
+                Bill(amount, size);
+        for (const auto &oxt : {Float("0.001"), Float("0.2"), Float(100)}) {
+            Convert(amount, oxt);
+            Convert(-amount, oxt);
+        }
+        for (const auto &[numerator, denominator] : std::vector<std::pair<uint256_t, uint256_t>>({{0, 1}, {1, 1}, {1, 3}, {2, 3}, {uint128_t(-1) - 1, uint128_t(-1)}}))
+            Scale(amount, numerator, denominator);
+    }
+
+    for (unsigned i(0); i != count; ++i) {
+        Bill(Random(random, -30, -3), std::uniform_int_distribution<size_t>(0, 1024 * 1024)(random));
+
+        const auto balance(Random(random, -30, 4));
+        Convert(i % 2 == 0 ? balance : -balance, Random(random, -3, 2));
+
+        const auto denominator(std::uniform_int_distribution<uint64_t>(1, uint64_t(-1))(random));
+        Scale(Random(random, -30, 6), std::uniform_int_distribution<uint64_t>(0, denominator)(random), denominator);
+
+        Fee(Random(random, -18, -12), uint256_t(std::uniform_int_distribution<uint64_t>(1, 1000)(random)) * 100000000, std::uniform_int_distribution<uint64_t>(21000, 1000000)(random));
+    }
+
+    std::cout << std::dec << checks_ << " checks, " << failures_ << " failures" << std::endl;
+    return failures_ == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, const char *const argv[]) { try {
+    return orc::Main(argc, argv);
+} catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+} }
@@ -0,0 +1,190 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+
+
+#include <iostream>
+#include <random>
+
+#include "segment.hpp"
+
+namespace orc {
+
+// Offload's checksums are stored the way the wire has them: everything here is checked with big-endian words
+
+static uint64_t checks_(0);
+static uint64_t failures_(0);
+
+static void Check(const char *name, bool passed, size_t detail) {
+    ++checks_;
+    if (passed)
+        return;
+    if (++failures_ <= 16)
+        std::cerr << name << ": " << detail << std::endl;
+}
+
+static uint32_t Add(const uint8_t *data, size_t size, uint32_t sum = 0) {
+    for (; size > 1; data += 2, size -= 2)
+        sum += data[0] << 8 | data[1];
+    if (size != 0)
+        sum += data[0] << 8;
+    return sum;
+}
+
+// a header whose checksum field is right sums (with the field) to negative zero
+static bool Valid(uint32_t sum) {
+    while ((sum >> 16) != 0)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum == 0xffff;
+}
+
+static uint32_t Pseudo(const uint8_t *ip, uint8_t protocol, size_t size) {
+    return Add(ip + 12, 8, protocol + uint32_t(size));
+}
+
+static uint32_t Get(const uint8_t *data, size_t size) {
+    uint32_t value(0);
+    for (size_t i(0); i != size; ++i)
+        value = value << 8 | data[i];
+    return value;
+}
+
+static void Fill(std::mt19937_64 &random, uint8_t *data, size_t size) {
+    std::uniform_int_distribution<unsigned> byte(0, 255);
+    for (size_t i(0); i != size; ++i)
+        data[i] = byte(random);
+}
+
+// an IPv4 header of ihl bytes (with random options) carrying protocol, with total length and checksum left to the caller
+static void Header(std::mt19937_64 &random, uint8_t *data, size_t ihl, uint8_t protocol, size_t total) {
+    Fill(random, data, ihl);
+    data[0] = 0x40 | ihl / 4;
+    data[2] = total >> 8;
+    data[3] = total;
+    data[9] = protocol;
+}
+
+// Offload::Segment: one TSO super-packet cut at mss
+static void Cut(std::mt19937_64 &random, size_t ihl, size_t thl, size_t payload, size_t mss) {
+    const auto headers(ihl + thl);
+    const auto size(headers + payload);
+    std::vector<uint8_t> packet(size);
+    const auto data(packet.data());
+    Header(random, data, ihl, IPPROTO_TCP, size);
+    Fill(random, data + ihl, size - ihl);
+    data[ihl + 12] = (thl / 4) << 4 | (data[ihl + 12] & 0x0f);
+
+    Beam beam;
+    const auto segments(Segment(beam, data, size, mss));
+    Check("count", segments.size() == (payload + mss - 1) / mss, segments.size());
+
+    const auto flags(data[ihl + 13]);
+    std::vector<uint8_t> joined;
+    for (size_t index(0); index != segments.size(); ++index) {
+        const auto &segment(segments[index]);
+        const auto at(segment.data());
+        const auto total(segment.size());
+        const auto last(index + 1 == segments.size());
+        Check("size", total > headers && (last ? total <= headers + mss : total == headers + mss), total);
+
+        Check("length", Get(at + 2, 2) == total, Get(at + 2, 2));
+        Check("id", Get(at + 4, 2) == ((Get(data + 4, 2) + index) & 0xffff), index);
+        Check("ip", memcmp(at, data, 2) == 0 && memcmp(at + 6, data + 6, 4) == 0 && memcmp(at + 12, data + 12, ihl - 12) == 0, index);
+        Check("ip checksum", Valid(Add(at, ihl)), index);
+
+        const auto tcp(at + ihl);
+        Check("sequence", Get(tcp + 4, 4) == ((Get(data + ihl + 4, 4) + joined.size()) & 0xffffffff), index);
+        Check("tcp", memcmp(tcp, data + ihl, 4) == 0 && memcmp(tcp + 8, data + ihl + 8, 5) == 0 && memcmp(tcp + 14, data + ihl + 14, 2) == 0 && memcmp(tcp + 18, data + ihl + 18, thl - 18) == 0, index);
+
+        // CWR goes out once, at the start; FIN and PSH go out once, at the end
+        auto expected(flags);
+        if (index != 0)
+            expected &= ~0x80;
+        if (!last)
+            expected &= ~0x09;
+        Check("flags", tcp[13] == expected, tcp[13]);
+
+        Check("tcp checksum", Valid(Add(tcp, total - ihl, Pseudo(at, IPPROTO_TCP, total - ihl))), index);
+        joined.insert(joined.end(), at + headers, at + total);
+    }
+
+    Check("payload", joined.size() == payload && memcmp(joined.data(), data + headers, payload) == 0, joined.size());
+}
+
+// Offload::Land: a VIRTIO_NET_HDR_F_NEEDS_CSUM packet, which the kernel seeded with the pseudo-header sum
+static void Partial(std::mt19937_64 &random, size_t ihl, uint8_t protocol, size_t payload) {
+    const auto offset(protocol == IPPROTO_TCP ? 16 : 6);
+    const auto size(ihl + payload);
+    std::vector<uint8_t> packet(size);
+    const auto data(packet.data());
+    Header(random, data, ihl, protocol, size);
+    Fill(random, data + ihl, payload);
+
+    auto seed(Pseudo(data, protocol, payload));
+    while ((seed >> 16) != 0)
+        seed = (seed & 0xffff) + (seed >> 16);
+    data[ihl + offset] = seed >> 8;
+    data[ihl + offset + 1] = seed;
+
+    Complete(data, size, ihl, offset);
+    Check(protocol == IPPROTO_TCP ? "tcp complete" : "udp complete", Valid(Add(data + ihl, payload, Pseudo(data, protocol, payload))), payload);
+}
+
+int Main(int argc, const char *const argv[]) {
+    orc_assert(argc <= 3);
+    const unsigned count(argc > 1 ? std::stoul(argv[1]) : 10000);
+    std::mt19937_64 random(argc > 2 ? std::stoull(argv[2]) : 0);
+
+    // boundaries: a single byte, exactly one and a few segments, one byte over, and an mss of one
+    for (const size_t mss : {1, 536, 1448, 1460})
+        for (const size_t payload : {size_t(1), mss - 1, mss, mss + 1, mss * 3, mss * 3 + 1})
+            if (payload != 0)
+                Cut(random, 20, 20, payload, mss);
+
+    for (const size_t payload : {8, 9, 20, 21, 1480})
+        for (const uint8_t protocol : {IPPROTO_TCP, IPPROTO_UDP})
+            if (protocol != IPPROTO_TCP || payload >= 20)
+                Partial(random, 20, protocol, payload);
+
+    std::uniform_int_distribution<size_t> words(5, 15);
+    for (unsigned i(0); i != count; ++i) {
+        const auto ihl(words(random) * 4);
+        const auto thl(words(random) * 4);
+        const auto payload(std::uniform_int_distribution<size_t>(1, 65535 - ihl - thl)(random));
+        Cut(random, ihl, thl, payload, std::uniform_int_distribution<size_t>(1, 9000)(random));
+
+        const auto protocol(i % 2 == 0 ? IPPROTO_TCP : IPPROTO_UDP);
+        Partial(random, ihl, protocol, std::uniform_int_distribution<size_t>(protocol == IPPROTO_TCP ? 20 : 8, 65535 - ihl)(random));
+    }
+
+    std::cout << std::dec << checks_ << " checks, " << failures_ << " failures" << std::endl;
+    return failures_ == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, const char *const argv[]) { try {
+    return orc::Main(argc, argv);
+} catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+} }
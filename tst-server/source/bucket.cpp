@@ -0,0 +1,100 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <deque>
+#include <sstream>
+
+#include "bucket.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+// whatever the pattern of calls, no run of seconds admits more than one second's worth beyond its length
+static void TestBound(Tester &tester, uint32_t rate, unsigned rounds) {
+    Bucket bucket;
+    auto now(tester.Uniform<uint32_t>(0, 1000));
+
+    // (second, calls admitted before it), oldest first
+    std::deque<std::pair<uint32_t, uint64_t>> seconds;
+    uint64_t admitted(0);
+
+    for (unsigned round(0); round != rounds; ++round) {
+        switch (tester.Uniform<unsigned>(0, 15)) {
+            case 0: now += tester.Uniform<uint32_t>(1, 100); break;
+            case 1: case 2: ++now; break;
+        }
+
+        if (seconds.empty() || seconds.back().first != now) {
+            seconds.emplace_back(now, admitted);
+            if (seconds.size() > 64)
+                seconds.pop_front();
+        }
+
+        if (bucket(rate, now))
+            ++admitted;
+
+        for (const auto &[second, before] : seconds) {
+            std::ostringstream what;
+            what << "bucket: " << admitted - before << " admitted in " << now - second + 1 << "s at " << rate << "/s";
+            tester.Check(admitted - before <= uint64_t(rate) * (now - second + 1), what.str());
+        }
+    }
+}
+
+// a backlog gets exactly rate a second, and anything at or under rate is never refused
+static void TestRate(Tester &tester, uint32_t rate) {
+    Bucket bucket;
+    auto now(tester.Uniform<uint32_t>(0, 1000));
+
+    for (unsigned second(0); second != 20; ++second, ++now) {
+        uint32_t admitted(0);
+        for (uint32_t call(0); call != rate + 10; ++call)
+            if (bucket(rate, now))
+                ++admitted;
+        std::ostringstream what;
+        what << "bucket: backlog got " << admitted << " in a second at " << rate << "/s";
+        tester.Check(admitted == rate, what.str());
+    }
+
+    for (unsigned second(0); second != 20; ++second) {
+        now += tester.Uniform<uint32_t>(1, 3);
+        const auto calls(tester.Uniform<uint32_t>(0, rate));
+        uint32_t admitted(0);
+        for (uint32_t call(0); call != calls; ++call)
+            if (bucket(rate, now))
+                ++admitted;
+        std::ostringstream what;
+        what << "bucket: refused " << calls - admitted << " of " << calls << " under " << rate << "/s";
+        tester.Check(admitted == calls, what.str());
+    }
+}
+
+void TestBucket(Tester &tester) {
+    for (const uint32_t rate : {1, 2, 3, 100})
+        TestRate(tester, rate);
+    for (unsigned i(0); i != 10; ++i) {
+        const auto rate(tester.Uniform<uint32_t>(1, 50));
+        TestRate(tester, rate);
+        TestBound(tester, rate, tester.count_ / 10 + 100);
+    }
+}
+
+}
@@ -0,0 +1,135 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <chrono>
+#include <map>
+#include <sstream>
+
+#include "gauge.hpp"
+#include "rates.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+// Cashier::Credit before Rates: every gauge point, in Float
+static std::pair<Float, uint256_t> Loop(const std::map<unsigned, double> &prices, const Fiat &fiat, const uint256_t &now, const uint256_t &start, const uint128_t &range, const uint128_t &amount, const uint256_t &gas) {
+    const auto base(Float(amount) * fiat.oxt_);
+    const auto until(start + range);
+
+    std::pair<Float, uint256_t> credit(0, 10*Gwei);
+    for (const auto &[price, time] : prices) {
+        const auto when(now + unsigned(time));
+        if (when >= until) continue;
+        const auto cost(price * Gwei / 10);
+        const auto profit((start < when ? base * Float(range - (when - start)) / Float(range) : base) - Float(gas * cost) * fiat.eth_);
+        if (profit > credit.first)
+            credit = {profit, cost};
+    }
+
+    return credit;
+}
+
+// a positive value with 18 significant digits, somewhere between 10^low and 10^high
+static Float Random(Tester &tester, int low, int high) {
+    const auto mantissa(tester.Uniform<uint64_t>(100000000000000000, 999999999999999999));
+    return Float(mantissa) * pow(Float(10), tester.Uniform<int>(low, high) - 17);
+}
+
+// mostly faster for more money (as a real gauge is), but not always
+static std::map<unsigned, double> Prices(Tester &tester, unsigned points) {
+    std::map<unsigned, double> prices;
+    double time(tester.Uniform<unsigned>(600, 7200));
+    while (prices.size() != points) {
+        prices.emplace(tester.Uniform<unsigned>(1, 5000), time);
+        time = std::max(1.0, time * tester.Uniform<unsigned>(50, 110) / 100 + tester.Uniform<unsigned>(0, 999) / 1000.0);
+    }
+    return prices;
+}
+
+// Rates must pick the point the Float loop did (or one it considered worth the same), and credit the same profit
+static void TestTable(Tester &tester, const std::map<unsigned, double> &prices, const Fiat &fiat, unsigned rounds) {
+    const Rates rates(prices, fiat);
+
+    for (unsigned i(0); i != rounds; ++i) {
+        const uint256_t origin(1600000000);
+        const auto range(tester.Uniform<unsigned>(1, 20000));
+        const auto start(origin + tester.Uniform<unsigned>(0, 30000));
+        const auto now(origin + tester.Uniform<unsigned>(0, 30000));
+        const uint128_t amount(Random(tester, 12, 20).convert_to<uint128_t>());
+        const uint256_t gas(tester.Uniform<unsigned>(21000, 200000));
+
+        const auto [expected, cost] = Loop(prices, fiat, now, start, range, amount, gas);
+        const auto [profit, actual] = rates.Credit(now, start, range, amount, gas);
+
+        // base and fee each round to half a unit before being multiplied, and Scale truncates one more
+        static const Float Unit("1e-30");
+        const auto bound(Unit * (Float(amount) + Float(gas) * Float(actual) + 2));
+
+        auto worth(expected);
+        if (actual != cost) {
+            worth = 0;
+            for (const auto &[price, time] : prices)
+                if (price * Gwei / 10 == actual)
+                    worth = std::get<0>(Loop({{price, time}}, fiat, now, start, range, amount, gas));
+        }
+
+        std::ostringstream what;
+        what << "credit: now " << now << " start " << start << " range " << range << " amount " << amount << " gas " << gas << " picked " << actual << " (" << Float(profit) << ") != " << cost << " (" << expected << ")";
+        tester.Check(abs(Float(profit) - expected) <= bound * 2 && abs(worth - expected) <= bound * 2, what.str());
+    }
+}
+
+template <typename Code_>
+static double Time(unsigned count, Code_ &&code) {
+    const auto before(std::chrono::steady_clock::now());
+    for (unsigned i(0); i != count; ++i)
+        code(i);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - before).count() / count;
+}
+
+void TestCredit(Tester &tester) {
+    for (const unsigned points : {1, 2, 5, 20, 80})
+        for (unsigned i(0); i != 10; ++i) {
+            const Fiat fiat{Random(tester, -16, -14), Random(tester, -20, -18)};
+            TestTable(tester, Prices(tester, points), fiat, tester.count_ / 50 + 10);
+        }
+
+    // a gauge the size of a real one, with tickets as a server sees them: recent, and fresh enough to decay
+    const auto prices(Prices(tester, 20));
+    const Fiat fiat{Float("3e-15"), Float("2e-19")};
+    const Rates rates(prices, fiat);
+    const uint256_t now(1600000000);
+    const uint128_t amount(uint64_t(1000000000000000000));
+    const auto count(tester.count_ / 10 + 100);
+
+    Float expected(0);
+    const auto loop(Time(count, [&](unsigned i) {
+        expected += Loop(prices, fiat, now, now - i % 600, 86400, amount, 100000).first;
+    }));
+    Money actual;
+    const auto table(Time(count, [&](unsigned i) {
+        actual += rates.Credit(now, now - i % 600, 86400, amount, 100000).first;
+    }));
+    tester.Check(abs(Float(actual) - expected) <= Float(count) * Float("1e-9"), "credit: benchmark disagreed");
+    std::cout << "credit: " << loop << "ns (float loop) " << table << "ns (table)" << std::endl;
+}
+
+}
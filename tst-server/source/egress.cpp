@@ -0,0 +1,208 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "egress.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+static void Put(uint8_t *data, uint32_t value, size_t size) {
+    for (size_t i(size); i != 0; --i, value >>= 8)
+        data[i - 1] = uint8_t(value);
+}
+
+static uint32_t Get(const uint8_t *data, size_t size) {
+    uint32_t value(0);
+    for (size_t i(0); i != size; ++i)
+        value = value << 8 | data[i];
+    return value;
+}
+
+// an empty UDP datagram; Egress patches checksums rather than checking them, so they are left as zero
+static Beam Datagram(const Socket &source, const Socket &destination) {
+    Beam packet(28);
+    const auto data(packet.data());
+    memset(data, 0, packet.size());
+    data[0] = 0x45;
+    Put(data + 2, packet.size(), 2);
+    data[8] = 64;
+    data[9] = IPPROTO_UDP;
+    Put(data + 12, uint32_t(source.Host()), 4);
+    Put(data + 16, uint32_t(destination.Host()), 4);
+    Put(data + 20, source.Port(), 2);
+    Put(data + 22, destination.Port(), 2);
+    Put(data + 24, 8, 2);
+    return packet;
+}
+
+static Socket Source(const Buffer &data) {
+    const Beam packet(data);
+    return {Host(Get(packet.data() + 12, 4)), uint16_t(Get(packet.data() + 20, 2))};
+}
+
+static Socket Destination(const Buffer &data) {
+    const Beam packet(data);
+    return {Host(Get(packet.data() + 16, 4)), uint16_t(Get(packet.data() + 22, 2))};
+}
+
+// what a client's connection looks like from Egress: something to Wire a translator under
+class Customer :
+    public Valve,
+    public BufferDrain,
+    public Sunken<Pump<Buffer>>
+{
+  public:
+    // where the last packet translated back to this client was headed
+    std::optional<Socket> landed_;
+
+  protected:
+    void Land(const Buffer &data) override {
+        landed_ = Destination(data);
+    }
+
+    void Stop(const std::string &error) noexcept override {
+    }
+
+  public:
+    task<void> Send(const Buffer &data) {
+        co_await Inner().Send(data);
+    }
+};
+
+// the transport under Egress, which sends nothing anywhere but remembers where the last packet was from
+class Upstream :
+    public Pump<Buffer>
+{
+  public:
+    std::optional<Socket> sent_;
+
+    Upstream(BufferDrain &drain) :
+        Pump<Buffer>(drain)
+    {
+    }
+
+    task<void> Send(const Buffer &data) override {
+        sent_ = Source(data);
+        co_return;
+    }
+
+    void Reply(const Buffer &data) {
+        Land(data);
+    }
+};
+
+// Egress never shuts down (its destructor insists as much), so neither it nor its clients are ever freed
+static void TestAddresses(Tester &tester, size_t addresses, size_t customers, size_t flows) {
+    std::vector<uint32_t> locals;
+    for (size_t i(0); i != addresses; ++i)
+        locals.emplace_back(0xc6336400 + i + 1);
+
+    // no per-client limits: what is being checked is that the pools alone have room
+    const auto egress(new S<BufferSink<Egress>>(Make<BufferSink<Egress>>(locals, 0, 0)));
+    auto &upstream((*egress)->BufferSunk::Wire<Upstream>());
+
+    std::vector<BufferSink<Customer> *> clients;
+    for (size_t i(0); i != customers; ++i) {
+        clients.emplace_back(new BufferSink<Customer>());
+        (*egress)->Egress::Wire(*clients.back());
+    }
+
+    const Socket remote(Host(0x08080808), 53);
+
+    // every client is 10.7.0.2 on its side of the tunnel, with flows from whatever ports its stack picks
+    std::vector<std::vector<Socket>> internals(customers);
+    for (auto &internal : internals) {
+        std::set<uint16_t> ports;
+        while (ports.size() != (flows + customers - 1) / customers)
+            ports.emplace(tester.Uniform<uint16_t>(1024, 65535));
+        for (const auto port : ports)
+            internal.emplace_back(Host(0x0a070002), port);
+        std::shuffle(internal.begin(), internal.end(), tester.random_);
+    }
+
+    // every flow is sent twice: a second look at a flow must find the same mapping, as nothing was evicted
+    std::map<std::pair<size_t, size_t>, Socket> mapped;
+    std::vector<std::optional<Host>> assigned(customers);
+    std::set<Socket> used;
+
+    for (unsigned pass(0); pass != 2; ++pass)
+        for (size_t flow(0); flow != flows; ++flow) {
+            const auto customer(flow % customers);
+            const auto &inside(internals[customer][flow / customers]);
+
+            upstream.sent_.reset();
+            Wait(clients[customer]->Send(Datagram(inside, remote)));
+            if (!upstream.sent_) {
+                tester.Check(false, "egress: flow dropped");
+                continue;
+            }
+
+            const auto translated(*upstream.sent_);
+            tester.Check(std::find(locals.begin(), locals.end(), uint32_t(translated.Host())) != locals.end(), "egress: sent from an address that is not ours");
+
+            auto &host(assigned[customer]);
+            if (!host)
+                host = translated.Host();
+            std::ostringstream what;
+            what << "egress: client " << customer << " moved from " << *host << " to " << translated.Host();
+            tester.Check(translated.Host() == *host, what.str());
+
+            if (pass == 0) {
+                tester.Check(used.emplace(translated).second, "egress: two live flows share a port");
+                mapped.emplace(std::make_pair(customer, flow / customers), translated);
+            } else
+                tester.Check(mapped.at(std::make_pair(customer, flow / customers)) == translated, "egress: flow remapped");
+        }
+
+    // clients are dealt out evenly, and keep their address for good
+    std::map<uint32_t, size_t> spread;
+    for (const auto &host : assigned)
+        if (host)
+            ++spread[*host];
+    for (const auto local : locals) {
+        std::ostringstream what;
+        what << "egress: " << Host(local) << " has " << spread[local] << " of " << customers << " clients";
+        tester.Check(spread[local] == customers / addresses, what.str());
+    }
+
+    // replies to a sample of the flows go back to the right client, addressed as it sent them
+    for (unsigned i(0); i != 1000; ++i) {
+        const auto flow(tester.Uniform<size_t>(0, flows - 1));
+        const auto customer(flow % customers);
+        const auto &inside(internals[customer][flow / customers]);
+
+        clients[customer]->landed_.reset();
+        upstream.Reply(Datagram(remote, mapped.at(std::make_pair(customer, flow / customers))));
+        tester.Check(clients[customer]->landed_ == inside, "egress: reply not delivered to its flow");
+    }
+}
+
+void TestEgress(Tester &tester) {
+    TestAddresses(tester, 4, 400, 200000);
+}
+
+}
@@ -0,0 +1,192 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <list>
+#include <map>
+#include <sstream>
+
+#include "fair.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+struct Packet {
+    const unsigned key_;
+    const size_t size_;
+    const std::chrono::steady_clock::time_point queued_;
+    bool granted_ = false;
+};
+
+typedef Fair<unsigned, Packet> Fair_;
+
+// against a model of each key's line: Turn answers at once only when nothing is waiting and a slot is free, drops
+// past Depth_, and otherwise queues; Next grants each key's packets in order and frees the slot only once nobody waits
+static void TestModel(Tester &tester, unsigned keys, unsigned rounds) {
+    Fair_ fair;
+    std::list<Packet> packets;
+    std::map<unsigned, std::deque<Packet *>> waiting;
+    size_t flight(0);
+
+    for (unsigned key(0); key != keys; ++key) {
+        fair.Open(key, tester.Uniform<uint32_t>(1, 8));
+        waiting[key];
+    }
+
+    const auto idle([&]() {
+        for (const auto &[key, line] : waiting)
+            if (!line.empty())
+                return false;
+        return true;
+    });
+
+    for (unsigned round(0); round != rounds; ++round) {
+        const auto key(tester.Uniform<unsigned>(0, keys - 1));
+        const auto line(waiting.find(key));
+
+        // stretches where senders outpace the transport (and lines fill to Depth_) alternate with ones where it catches up
+        const auto step(tester.Uniform<unsigned>(0, 63));
+        const auto burst((round / 512) % 2 == 0);
+
+        switch (step == 0 ? 0 : step < (burst ? 8 : 40) ? 1 : 2) {
+            // a translator going away, and (maybe later) another taking its place
+            case 0: {
+                if (line == waiting.end()) {
+                    if (tester.Uniform<unsigned>(0, 3) == 0) {
+                        fair.Open(key, tester.Uniform<uint32_t>(1, 8));
+                        waiting[key];
+                    }
+                    break;
+                }
+
+                const auto dropped(fair.Close(key));
+                tester.Check(std::equal(dropped.begin(), dropped.end(), line->second.begin(), line->second.end()), "fair: close lost track of its line");
+                waiting.erase(line);
+            } break;
+
+            // the transport accepting a packet
+            case 1: {
+                if (flight == 0)
+                    break;
+                const auto next(fair.Next());
+                if (next == nullptr) {
+                    --flight;
+                    tester.Check(idle(), "fair: slot freed while packets wait");
+                    break;
+                }
+
+                const auto granted(waiting.find(next->key_));
+                tester.Check(granted != waiting.end() && !granted->second.empty() && granted->second.front() == next && next->granted_, "fair: granted out of order");
+                if (granted != waiting.end() && !granted->second.empty() && granted->second.front() == next)
+                    granted->second.pop_front();
+            } break;
+
+            default: {
+                const auto clear(idle() && !fair.Waiting());
+                auto &packet(packets.emplace_back(Packet{key, tester.Uniform<size_t>(40, 1500), {}}));
+                const auto turn(fair.Turn(key, packet));
+
+                std::ostringstream what;
+                what << "fair: turn for " << key << " with " << flight << " in flight";
+
+                if (line == waiting.end())
+                    tester.Check(turn && !*turn, what.str() + " after close");
+                else if (turn && *turn) {
+                    tester.Check(idle() && flight != Fair_::Flight_, what.str() + " jumped the line");
+                    ++flight;
+                } else if (clear && flight != Fair_::Flight_)
+                    tester.Check(false, what.str() + " missed the fast path");
+                else if (turn)
+                    tester.Check(line->second.size() == Fair_::Depth_, what.str() + " dropped early");
+                else {
+                    tester.Check(line->second.size() < Fair_::Depth_, what.str() + " queued past depth");
+                    line->second.emplace_back(&packet);
+                }
+            } break;
+        }
+
+        tester.Check(fair.Flight() == flight && flight <= Fair_::Flight_, "fair: flight");
+        // a packet is only ever queued once every slot is taken, and the slots stay taken until the lines are empty
+        tester.Check(!fair.Waiting() || flight == Fair_::Flight_, "fair: waiting with a slot free");
+        tester.Check(flight != 0 || idle(), "fair: packets stranded with nothing in flight");
+    }
+}
+
+// with every key backlogged, each gets bytes in proportion to its weight: a key's grants lag its credit by
+// less than one quantum of its weight plus a packet, and credit is handed out in rounds
+static void TestShares(Tester &tester, unsigned keys, unsigned grants) {
+    Fair_ fair;
+    std::list<Packet> packets;
+    std::vector<uint32_t> weights;
+    std::vector<uint64_t> bytes(keys);
+
+    const auto turn([&](unsigned key) {
+        auto &packet(packets.emplace_back(Packet{key, tester.Uniform<size_t>(40, 1500), {}}));
+        return fair.Turn(key, packet);
+    });
+
+    for (unsigned key(0); key != keys; ++key) {
+        weights.emplace_back(tester.Uniform<uint32_t>(1, 8));
+        fair.Open(key, weights.back());
+    }
+
+    size_t flight(0);
+    for (unsigned key(0); key != keys; ++key)
+        for (size_t i(0); i != Fair_::Depth_; ++i)
+            if (const auto granted = turn(key)) {
+                tester.Check(*granted, "fair: dropped while filling");
+                ++flight;
+            }
+    tester.Check(flight == Fair_::Flight_, "fair: fast path did not fill the flight");
+
+    for (unsigned grant(0); grant != grants; ++grant) {
+        const auto next(fair.Next());
+        tester.Check(next != nullptr && fair.Flight() == Fair_::Flight_, "fair: backlog ran dry");
+        if (next == nullptr)
+            return;
+        bytes[next->key_] += next->size_;
+        tester.Check(!turn(next->key_), "fair: refill was not queued");
+    }
+
+    double low(std::numeric_limits<double>::max()), high(0);
+    for (unsigned key(0); key != keys; ++key) {
+        const auto share(double(bytes[key]) / weights[key]);
+        low = std::min(low, share);
+        high = std::max(high, share);
+    }
+
+    std::ostringstream what;
+    what << "fair: bytes per weight ranged " << low << " to " << high << " over " << keys << " keys";
+    tester.Check(high - low <= 2 * Fair_::Quantum_ + 1500, what.str());
+}
+
+void TestFair(Tester &tester) {
+    for (const unsigned keys : {1, 2, 3, 8})
+        TestModel(tester, keys, tester.count_ + 100);
+    for (unsigned i(0); i != 10; ++i) {
+        TestModel(tester, tester.Uniform<unsigned>(1, 40), tester.count_ + 100);
+        TestShares(tester, tester.Uniform<unsigned>(1, 10), tester.count_ + 100);
+    }
+}
+
+}
@@ -0,0 +1,59 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include "error.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+int Main(int argc, const char *const argv[]) {
+    orc_assert(argc <= 3);
+    Tester tester(argc > 1 ? std::stoul(argv[1]) : 10000, argc > 2 ? std::stoull(argv[2]) : 0);
+
+    for (const auto &[name, test] : std::initializer_list<std::pair<const char *, void (*)(Tester &)>>{
+        {"bucket", &TestBucket},
+        {"credit", &TestCredit},
+        {"egress", &TestEgress},
+        {"fair", &TestFair},
+        {"ports", &TestPorts},
+        {"recent", &TestRecent},
+        {"replay", &TestReplay},
+        {"spool", &TestSpool},
+        {"wheel", &TestWheel},
+    }) {
+        const auto before(tester.failures());
+        test(tester);
+        std::cout << name << ": " << (tester.failures() == before ? "ok" : "FAILED") << std::endl;
+    }
+
+    std::cout << std::dec << tester.checks() << " checks, " << tester.failures() << " failures" << std::endl;
+    return tester.failures() == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, const char *const argv[]) { try {
+    return orc::Main(argc, argv);
+} catch (const std::exception &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+} }
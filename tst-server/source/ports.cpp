@@ -0,0 +1,121 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <set>
+#include <sstream>
+
+#include "ports.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+struct Slot {
+    std::atomic<bool> used_ = false;
+    bool heavy_ = false;
+};
+
+// the free list hands out each slot once, and the hand takes the first slot from where it stopped last time
+// that has not been touched since it was passed (or whose owner is heavy), clearing the ones it skips
+static void TestClock(Tester &tester, size_t size, unsigned rounds) {
+    Ports<Slot> ports(size);
+    std::set<uint16_t> live;
+    size_t hand(0);
+
+    for (unsigned round(0); round != rounds; ++round) {
+        switch (tester.Uniform<unsigned>(0, 5)) {
+            // traffic
+            case 0: case 1:
+                ports[tester.Uniform<size_t>(0, size - 1)].used_ = true;
+                break;
+
+            // an owner going over (or back under) its share
+            case 2:
+                ports[tester.Uniform<size_t>(0, size - 1)].heavy_ = tester.Uniform<unsigned>(0, 7) == 0;
+                break;
+
+            // a flow closing (or expiring)
+            case 3: {
+                if (live.empty() || tester.Uniform<unsigned>(0, 3) != 0)
+                    break;
+                auto index(live.begin());
+                std::advance(index, tester.Uniform<size_t>(0, live.size() - 1));
+                ports.Free(*index);
+                tester.Check(!ports[*index].used_, "clock: freed slot still marked used");
+                live.erase(index);
+            } break;
+
+            // a new flow
+            default: {
+                if (!ports.Full()) {
+                    tester.Check(live.size() != size, "clock: free slot while all are live");
+                    const auto index(ports.Take());
+                    std::ostringstream what;
+                    what << "clock: took live slot " << index;
+                    tester.Check(index < size && live.emplace(index).second, what.str());
+                    break;
+                }
+
+                tester.Check(live.size() == size, "clock: full while some are free");
+
+                std::vector<bool> touched(size);
+                for (size_t i(0); i != size; ++i)
+                    touched[i] = ports[i].used_;
+
+                auto expected(hand);
+                for (size_t i(0); i != size; ++i) {
+                    const auto index((hand + i) % size);
+                    if (!touched[index] || ports[index].heavy_) {
+                        expected = index;
+                        break;
+                    }
+                }
+
+                const auto index(ports.Victim([](const Slot &slot) { return slot.heavy_; }));
+
+                std::ostringstream what;
+                what << "clock: evicted " << index << " != " << expected << " (hand at " << hand << ")";
+                tester.Check(index == expected, what.str());
+
+                // everything from the hand up to the victim lost its second chance (a whole lap if there was no victim)
+                bool cleared(true);
+                for (auto i(hand); ; i = (i + 1) % size) {
+                    cleared = cleared && !ports[i].used_;
+                    if (i == expected)
+                        break;
+                }
+                tester.Check(cleared, "clock: skipped a slot without clearing it");
+
+                hand = (expected + 1) % size;
+                ports.Free(index);
+                tester.Check(ports.Take() == index, "clock: freed victim not reused");
+            } break;
+        }
+    }
+}
+
+void TestPorts(Tester &tester) {
+    for (const size_t size : {1, 2, 3, 16, 256})
+        TestClock(tester, size, tester.count_ + 100);
+    for (unsigned i(0); i != 10; ++i)
+        TestClock(tester, tester.Uniform<size_t>(1, 1000), tester.count_ + 100);
+}
+
+}
@@ -0,0 +1,156 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <sstream>
+#include <vector>
+
+#include "recent.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+struct Memo {
+    unsigned value_ = 0;
+    // stands in for the cashier's pot that nobody has heard about yet
+    bool pinned_ = false;
+};
+
+struct Remembered {
+    unsigned key_;
+    Memo memo_;
+    Recent<unsigned, Memo>::Time used_;
+};
+
+// the cold end, as Recent sees it (an eviction that keeps everything walks all of it)
+static std::vector<unsigned> Coldest(Recent<unsigned, Memo> &recent, Recent<unsigned, Memo>::Time now) {
+    std::vector<unsigned> keys;
+    recent.Evict(0, std::chrono::seconds(0), now, [&](unsigned key, Memo &) {
+        keys.emplace_back(key);
+        return false;
+    });
+    return keys;
+}
+
+// against a list kept hottest first: Touch moves (or adds) to the front, Append adds to the back, and Evict
+// walks from the back dropping what it is allowed to until the size is in bounds and the coldest is fresh
+static void TestOrder(Tester &tester, unsigned keys, size_t maximum, unsigned rounds) {
+    Recent<unsigned, Memo> recent;
+    std::vector<Remembered> model;
+
+    const Recent<unsigned, Memo>::Time start;
+    auto now(start);
+    const std::chrono::seconds idle(tester.Uniform<unsigned>(1, 50));
+
+    const auto find([&](unsigned key) {
+        for (auto entry(model.begin()); entry != model.end(); ++entry)
+            if (entry->key_ == key)
+                return entry;
+        return model.end();
+    });
+
+    // warm load, as from a snapshot
+    for (unsigned key(0), count(tester.Uniform<unsigned>(0, keys / 2)); key != count; ++key) {
+        recent.Append(key, now).value_ = key;
+        model.push_back({key, {key, false}, now});
+    }
+
+    for (unsigned round(0); round != rounds; ++round) {
+        now += std::chrono::seconds(tester.Uniform<unsigned>(0, 3));
+        const auto key(tester.Uniform<unsigned>(0, keys - 1));
+
+        switch (tester.Uniform<unsigned>(0, 5)) {
+            case 0: {
+                const auto memo(recent.Find(key));
+                const auto entry(find(key));
+                std::ostringstream what;
+                what << "recent: find " << key;
+                tester.Check(entry == model.end() ? memo == nullptr : memo != nullptr && memo->value_ == entry->memo_.value_, what.str());
+            } break;
+
+            // whatever was pinned gets heard about
+            case 1:
+                for (auto &entry : model)
+                    if (entry.memo_.pinned_) {
+                        entry.memo_.pinned_ = false;
+                        recent.Find(entry.key_)->pinned_ = false;
+                    }
+                break;
+
+            default: {
+                auto [memo, inserted] = recent.Touch(key, now);
+                const auto entry(find(key));
+
+                std::ostringstream what;
+                what << "recent: touch " << key << (inserted ? " added" : " kept");
+                tester.Check(inserted == (entry == model.end()), what.str());
+
+                Remembered touched{key, {}, now};
+                if (!inserted) {
+                    tester.Check(memo.value_ == entry->memo_.value_, what.str());
+                    touched.memo_ = entry->memo_;
+                    model.erase(entry);
+                } else {
+                    memo.value_ = round;
+                    memo.pinned_ = tester.Uniform<unsigned>(0, 3) == 0;
+                    touched.memo_ = memo;
+                }
+                model.insert(model.begin(), touched);
+
+                std::vector<unsigned> expected;
+                for (auto index(model.size()); index-- != 0; ) {
+                    const auto &cold(model[index]);
+                    if (model.size() <= maximum && now - cold.used_ < idle)
+                        break;
+                    if (cold.memo_.pinned_)
+                        continue;
+                    expected.emplace_back(cold.key_);
+                    model.erase(model.begin() + index);
+                }
+
+                std::vector<unsigned> evicted;
+                recent.Evict(maximum, idle, now, [&](unsigned key, Memo &memo) {
+                    if (memo.pinned_)
+                        return false;
+                    evicted.emplace_back(key);
+                    return true;
+                });
+
+                tester.Check(evicted == expected, "recent: evicted the wrong entries");
+            } break;
+        }
+
+        tester.Check(recent.size() == model.size(), "recent: size");
+
+        std::vector<unsigned> coldest;
+        for (auto entry(model.rbegin()); entry != model.rend(); ++entry)
+            coldest.emplace_back(entry->key_);
+        tester.Check(Coldest(recent, now) == coldest, "recent: order");
+    }
+}
+
+void TestRecent(Tester &tester) {
+    for (const size_t maximum : {1, 2, 16})
+        TestOrder(tester, 32, maximum, tester.count_ / 10 + 100);
+    for (unsigned i(0); i != 10; ++i)
+        TestOrder(tester, tester.Uniform<unsigned>(1, 200), tester.Uniform<size_t>(1, 100), tester.count_ / 10 + 100);
+}
+
+}
@@ -0,0 +1,166 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "crypto.hpp"
+#include "replay.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+// Server::Submit's window before Replay: an ordered set, evicting one ticket at a time
+class Ordered {
+  private:
+    const size_t horizon_;
+    uint256_t issued_ = 0;
+    std::set<std::tuple<uint256_t, Bytes32, Address>> nonces_;
+
+  public:
+    Ordered(size_t horizon) :
+        horizon_(horizon)
+    {
+    }
+
+    bool operator ()(const uint256_t &issued, const Bytes32 &nonce, const Address &signer) {
+        if (issued < issued_)
+            return false;
+        if (!nonces_.emplace(issued, nonce, signer).second)
+            return false;
+        while (nonces_.size() > horizon_) {
+            const auto oldest(nonces_.begin());
+            issued_ = std::get<0>(*oldest) + 1;
+            nonces_.erase(oldest);
+        }
+        return true;
+    }
+};
+
+static Bytes32 Nonce(unsigned value) {
+    auto nonce(Zero<32>());
+    for (unsigned i(0); i != sizeof(value); ++i)
+        nonce[i] = uint8_t(value >> i * 8);
+    return nonce;
+}
+
+// Replay must admit exactly the tickets the ordered set did, while never holding more than horizon
+static void TestWindow(Tester &tester, size_t horizon, unsigned tickets, unsigned nonces, unsigned jitter) {
+    Replay replay(horizon);
+    Ordered ordered(horizon);
+
+    uint256_t now(1000);
+    for (unsigned i(0); i != tickets; ++i) {
+        // mostly in order, sometimes late, sometimes many sharing a timestamp; small pools make for repeats
+        now += tester.Uniform<unsigned>(0, 2);
+        const uint256_t issued(now - tester.Uniform<unsigned>(0, jitter));
+        const auto nonce(Nonce(tester.Uniform<unsigned>(0, nonces)));
+        const Address signer(uint160_t(tester.Uniform<unsigned>(1, 3)));
+
+        const auto expected(ordered(issued, nonce, signer));
+        const auto actual(replay(issued, nonce, signer));
+
+        std::ostringstream what;
+        what << "replay(" << horizon << "): ticket " << i << " issued " << issued << " admitted " << actual << " != " << expected;
+        tester.Check(actual == expected, what.str());
+        tester.Check(replay.size() <= horizon, "replay: over horizon");
+    }
+}
+
+// a replaced commit must pay out for exactly one more minute, and be forgotten once nothing will accept it
+static void TestReveals(Tester &tester, unsigned commits) {
+    Reveals reveals;
+    // every commit ever made, with when it was replaced (0 while current)
+    std::map<Bytes32, std::pair<Bytes32, uint256_t>> made;
+
+    uint256_t now(1000);
+    for (unsigned i(0); i != commits; ++i) {
+        now += tester.Uniform<unsigned>(0, 40);
+
+        if (i == 0 || tester.Uniform<unsigned>(0, 3) == 0) {
+            if (i != 0)
+                made.at(reveals.Current()).second = now;
+            const auto reveal(Nonce(i * 2));
+            const auto commit(Nonce(i * 2 + 1));
+            reveals.Commit(commit, reveal, now);
+            made.emplace(commit, std::make_pair(reveal, uint256_t(0)));
+
+            size_t live(0);
+            for (const auto &[commit, value] : made)
+                if (value.second == 0 || value.second + 60 > now)
+                    ++live;
+            tester.Check(reveals.size() == live, "reveals: kept a commit nobody will accept");
+        }
+
+        // ask about a random commit (sometimes one that was never made)
+        const auto asked(Nonce(tester.Uniform<unsigned>(0, i * 2 + 2)));
+        const auto found(made.find(asked));
+        const auto expected(found != made.end() && (found->second.second == 0 || found->second.second + 60 > now));
+
+        bool actual;
+        try {
+            const auto reveal(reveals(asked, now));
+            actual = found != made.end() && reveal == found->second.first;
+        } catch (const std::exception &error) {
+            actual = false;
+        }
+
+        std::ostringstream what;
+        what << "reveals: commit " << asked << " at " << now << " accepted " << actual << " != " << expected;
+        tester.Check(actual == expected, what.str());
+    }
+}
+
+// the reference vectors from the SipHash paper, keyed 00..0f over the message 00 01 02 ...
+static void TestSipHash(Tester &tester) {
+    Brick<16> key;
+    for (unsigned i(0); i != key.size(); ++i)
+        key[i] = uint8_t(i);
+    uint8_t data[64];
+    for (unsigned i(0); i != sizeof(data); ++i)
+        data[i] = uint8_t(i);
+
+    for (const auto &[size, expected] : std::initializer_list<std::pair<size_t, uint64_t>>{
+        {0, 0x726fdb47dd0e0e31}, {1, 0x74f839c593dc67fd}, {7, 0xab0200f58b01d137},
+        {8, 0x93f5f5799a932462}, {15, 0xa129ca6149be45e5}, {63, 0x958a324ceb064572},
+    }) {
+        std::ostringstream what;
+        what << "siphash: " << size << " bytes";
+        tester.Check(SipHash(key, data, size) == expected, what.str());
+    }
+}
+
+void TestReplay(Tester &tester) {
+    TestSipHash(tester);
+
+    for (const size_t horizon : {1, 2, 3, 10, 64})
+        for (const unsigned jitter : {0, 1, 5, 100})
+            TestWindow(tester, horizon, tester.count_ / 10 + 100, horizon * 4, jitter);
+
+    for (unsigned i(0); i != 10; ++i)
+        TestWindow(tester, tester.Uniform<size_t>(1, 100), tester.count_ / 10 + 100, tester.Uniform<unsigned>(1, 1000), tester.Uniform<unsigned>(0, 20));
+
+    TestReveals(tester, tester.count_ + 10);
+}
+
+}
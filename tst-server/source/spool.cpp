@@ -0,0 +1,159 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <cstdlib>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "journal.hpp"
+#include "test.hpp"
+
+namespace orc {
+
+// Spool's group commit, minus the submitter and with a way to make a pass fail part way through
+class Grabs :
+    public Journal
+{
+  private:
+    Database database_;
+    Statement<None, std::string> insert_;
+    Batch<std::string> pending_;
+
+    void Commit() override {
+        pending_.Take([&](const std::vector<std::string> &pending) {
+            Transact(database_, [&]() {
+                for (const auto &grab : pending) {
+                    orc_assert_(fail_-- != 0, "disk full");
+                    insert_(grab);
+                }
+            });
+        });
+    }
+
+  public:
+    // how many more rows get written before one fails
+    size_t fail_ = -1;
+
+    Grabs(const std::string &path) :
+        Journal(0),
+        database_(path),
+        insert_(database_, R"(
+            insert into "grab" ("data") values (?)
+        )")
+    {
+        // the worker is never started: the test runs each pass itself
+    }
+
+    ~Grabs() override {
+        Stop();
+    }
+
+    void Push(std::string grab) {
+        pending_.Push(std::move(grab));
+        Pushed();
+    }
+
+    bool Pass() {
+        try {
+            Commit();
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+};
+
+static std::vector<std::string> Written(Database &database) {
+    std::vector<std::string> written;
+    for (const auto &[data] : Statement<Rows<std::string>>(database, R"(
+        select "data" from "grab" order by "id"
+    )")())
+        written.emplace_back(data);
+    return written;
+}
+
+// everything pushed is written exactly once, in order, however many passes fail (and however far they got)
+static void TestCommit(Tester &tester, const std::string &path, unsigned rounds) {
+    Database other(path);
+    Statement<None>(other, R"(
+        create table "grab" (
+            "id" integer primary key autoincrement,
+            "data" text not null
+        )
+    )")();
+
+    Grabs grabs(path);
+    std::vector<std::string> pushed;
+    bool locked(false);
+
+    for (unsigned round(0); round != rounds; ++round) {
+        for (auto count(tester.Uniform<unsigned>(0, 4)); count != 0; --count) {
+            pushed.emplace_back(std::to_string(pushed.size()));
+            grabs.Push(pushed.back());
+        }
+
+        switch (tester.Uniform<unsigned>(0, 5)) {
+            // another connection holding the write lock, so the first insert is refused (SQLITE_BUSY)
+            case 0:
+                Statement<None>(other, locked ? R"(rollback)" : R"(begin immediate)")();
+                locked = !locked;
+                break;
+
+            // a failure after some of the batch made it into the transaction
+            case 1:
+                grabs.fail_ = tester.Uniform<size_t>(0, 4);
+                break;
+        }
+
+        const auto before(Written(other));
+        const auto pending(pushed.size() - before.size());
+        const auto expected(pending == 0 || !locked && grabs.fail_ >= pending);
+        const auto passed(grabs.Pass());
+        grabs.fail_ = -1;
+
+        std::ostringstream what;
+        what << "spool: round " << round << " passed " << passed << " != " << expected;
+        tester.Check(passed == expected, what.str());
+
+        // a failed pass leaves nothing behind; a good one writes everything so far
+        if (locked)
+            continue;
+        const auto written(Written(other));
+        tester.Check(written == (passed ? pushed : before), "spool: wrong rows after a pass");
+    }
+
+    if (locked)
+        Statement<None>(other, R"(rollback)")();
+    tester.Check(grabs.Pass() && Written(other) == pushed, "spool: lost rows");
+}
+
+void TestSpool(Tester &tester) {
+    char path[] = "/tmp/orchid-spool-XXXXXX";
+    const auto file(mkstemp(path));
+    orc_assert(file != -1);
+    close(file);
+
+    orc_ignore({ TestCommit(tester, path, tester.count_ / 10 + 100); });
+    unlink(path);
+}
+
+}
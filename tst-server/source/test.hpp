@@ -0,0 +1,83 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_TEST_HPP
+#define ORCHID_TEST_HPP
+
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace orc {
+
+// each test runs count_ randomized rounds (plus whatever boundaries it knows about) and reports through Check
+class Tester {
+  public:
+    const unsigned count_;
+    std::mt19937_64 random_;
+
+  private:
+    uint64_t checks_ = 0;
+    uint64_t failures_ = 0;
+
+  public:
+    Tester(unsigned count, uint64_t seed) :
+        count_(count),
+        random_(seed)
+    {
+    }
+
+    template <typename Type_>
+    Type_ Uniform(Type_ low, Type_ high) {
+        return std::uniform_int_distribution<Type_>(low, high)(random_);
+    }
+
+    void Check(bool success, const std::string &what) {
+        ++checks_;
+        if (success)
+            return;
+        if (++failures_ <= 16)
+            std::cerr << what << std::endl;
+    }
+
+    uint64_t checks() const {
+        return checks_;
+    }
+
+    uint64_t failures() const {
+        return failures_;
+    }
+};
+
+void TestBucket(Tester &tester);
+void TestCredit(Tester &tester);
+void TestEgress(Tester &tester);
+void TestFair(Tester &tester);
+void TestPorts(Tester &tester);
+void TestRecent(Tester &tester);
+void TestReplay(Tester &tester);
+void TestSpool(Tester &tester);
+void TestWheel(Tester &tester);
+
+}
+
+#endif//ORCHID_TEST_HPP
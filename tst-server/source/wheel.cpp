@@ -0,0 +1,119 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#include <sstream>
+
+#include "test.hpp"
+#include "wheel.hpp"
+
+namespace orc {
+
+// Egress's use of the wheel, with a slot's timeout either growing (a reply) or shrinking (FIN, RST) over its life
+struct Flow {
+    bool live_ = false;
+    uint32_t generation_ = 0;
+    uint32_t seen_ = 0;
+    uint32_t timeout_ = 0;
+
+    uint32_t Deadline() const {
+        return seen_ + timeout_;
+    }
+};
+
+static const uint32_t Timeouts_[] = {10, 60, 240, 300, 7440};
+
+// a flow must be expired within one tick of its deadline, however far ahead it was filed or however long a stall
+static void TestTurn(Tester &tester, uint32_t tick, size_t size, size_t flows, unsigned rounds) {
+    Wheel wheel(tick, size);
+    std::vector<Flow> table(flows);
+
+    // as with Egress::Now, time starts with the wheel
+    uint32_t now(0);
+
+    for (unsigned round(0); round != rounds; ++round) {
+        const auto index(tester.Uniform<uint16_t>(0, flows - 1));
+        auto &flow(table[index]);
+
+        switch (tester.Uniform<unsigned>(0, 9)) {
+            case 0: case 1:
+                if (flow.live_)
+                    flow.live_ = false;
+                else {
+                    flow.live_ = true;
+                    ++flow.generation_;
+                    flow.seen_ = now;
+                    flow.timeout_ = Timeouts_[tester.Uniform<size_t>(0, std::size(Timeouts_) - 1)];
+                    wheel.File(index, flow.generation_, flow.Deadline());
+                }
+                break;
+
+            case 2: case 3:
+                if (flow.live_)
+                    flow.seen_ = now;
+                break;
+
+            case 4:
+                if (flow.live_) {
+                    const auto timeout(Timeouts_[tester.Uniform<size_t>(0, std::size(Timeouts_) - 1)]);
+                    flow.seen_ = now;
+                    // only a shorter timeout needs filing again: a longer one is found (and refiled) by the old entry
+                    if (timeout < std::exchange(flow.timeout_, timeout))
+                        wheel.File(index, flow.generation_, flow.Deadline());
+                }
+                break;
+
+            default: {
+                // mostly a tick at a time, sometimes a stall of more than a lap
+                if (tester.Uniform<unsigned>(0, 99) == 0)
+                    now += tester.Uniform<uint32_t>(0, tick * uint32_t(size) * 3);
+                else
+                    now += tester.Uniform<uint32_t>(0, tick * 2);
+
+                wheel.Turn(now, [&](uint16_t index, uint32_t generation) -> uint32_t {
+                    auto &flow(table[index]);
+                    if (!flow.live_ || flow.generation_ != generation)
+                        return 0;
+                    if (flow.Deadline() > now)
+                        return flow.Deadline();
+                    flow.live_ = false;
+                    return 0;
+                });
+
+                for (size_t i(0); i != flows; ++i)
+                    if (table[i].live_) {
+                        std::ostringstream what;
+                        what << "wheel(" << tick << ", " << size << "): " << i << " due " << table[i].Deadline() << " still live at " << now;
+                        tester.Check(table[i].Deadline() + tick > now, what.str());
+                    }
+            } break;
+        }
+    }
+}
+
+void TestWheel(Tester &tester) {
+    for (const uint32_t tick : {1, 4, 7})
+        for (const size_t size : {1, 2, 16, 512})
+            TestTurn(tester, tick, size, 64, tester.count_ / 2 + 100);
+    for (unsigned i(0); i != 10; ++i)
+        TestTurn(tester, tester.Uniform<uint32_t>(1, 10), tester.Uniform<size_t>(1, 2000), tester.Uniform<size_t>(1, 1000), tester.count_ / 2 + 100);
+}
+
+}
@@ -33,7 +33,12 @@
 
 namespace orc {
 
-void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code) {
+void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code, unsigned queues, bool offload, bool uring, unsigned batch) {
+    orc_assert_(queues == 1, "utun only has a single queue");
+    orc_assert_(!offload, "utun does not support offload");
+    orc_assert_(!uring, "io_uring is only on Linux");
+    orc_assert_(batch == 1, "utun is read one packet at a time");
+
     auto &family(sunk.Wire<BufferSink<Family>>());
     auto &sync(family.Wire<Sync<asio::generic::datagram_protocol::socket>>(Context(), asio::generic::datagram_protocol(PF_SYSTEM, SYSPROTO_CONTROL)));
     auto file(sync->native_handle());
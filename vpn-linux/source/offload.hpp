@@ -0,0 +1,106 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+/* }}} */
+
+
+#ifndef ORCHID_OFFLOAD_HPP
+#define ORCHID_OFFLOAD_HPP
+
+#include <cstring>
+
+// virtio_net_ctrl_hdr has a field named class, which only a C compiler accepts
+#define class class_
+#include <linux/virtio_net.h>
+#undef class
+
+#include "link.hpp"
+#include "log.hpp"
+#include "segment.hpp"
+
+namespace orc {
+
+// strips the virtio_net_hdr a TUN with IFF_VNET_HDR puts on every packet; everything past here
+// is bounded by the tunnel's MTU, so TSO super-packets are cut back into segments, but only once
+// they have been read in one go, and checksums the kernel left to us are filled in; packets the
+// other way are written one by one (with an empty header), as nothing here coalesces them for GRO
+class Offload :
+    public Link<Buffer>,
+    public Sunken<Pump<Buffer>>
+{
+  private:
+    // written ahead of every packet we send: no offload requested
+    static inline const Brick<sizeof(virtio_net_hdr)> None_{};
+
+    void Segment(const uint8_t *data, size_t size, size_t mss) {
+        Beam beam;
+        const auto segments(orc::Segment(beam, data, size, mss));
+
+        // everything cut from one super-packet goes on together
+        std::vector<const Buffer *> flood;
+        flood.reserve(segments.size());
+        for (const auto &segment : segments)
+            flood.emplace_back(&segment);
+        Faucet<BufferDrain>::Outer().Flood(flood);
+    }
+
+  protected:
+    void Land(const Buffer &data) override {
+        const auto [bytes, packet] = Take<Brick<sizeof(virtio_net_hdr)>, Window>(data);
+        virtio_net_hdr header;
+        memcpy(&header, bytes.data(), sizeof(header));
+
+        const auto type(header.gso_type & ~VIRTIO_NET_HDR_GSO_ECN);
+        if (type == VIRTIO_NET_HDR_GSO_NONE && (header.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) == 0)
+            return Link::Land(packet);
+
+        Beam beam(packet);
+
+        // TUN_F_CSUM | TUN_F_TSO4 is all TUNSETOFFLOAD is asked for, so this is all that can arrive
+        if (type == VIRTIO_NET_HDR_GSO_TCPV4)
+            return Segment(beam.data(), beam.size(), header.gso_size);
+
+        if (type != VIRTIO_NET_HDR_GSO_NONE) {
+            Log() << "dropping offloaded packet of type " << unsigned(header.gso_type) << std::endl;
+            return;
+        }
+
+        Complete(beam.data(), beam.size(), header.csum_start, header.csum_offset);
+        return Link::Land(beam);
+    }
+
+  public:
+    Offload(BufferDrain &drain) :
+        Link<Buffer>(drain)
+    {
+    }
+
+    task<void> Shut() noexcept override {
+        co_await Sunken::Shut();
+        co_await Link::Shut();
+    }
+
+    task<void> Send(const Buffer &data) override {
+        co_return co_await Inner().Send(Tie(None_, data));
+    }
+};
+
+}
+
+#endif//ORCHID_OFFLOAD_HPP
@@ -36,6 +36,10 @@ class PacketInfo :
         return Link::Land(data);
     }
 
+    void Flood(const std::vector<const Buffer *> &data) override {
+        return Faucet<BufferDrain>::Outer().Flood(data);
+    }
+
   public:
     PacketInfo(BufferDrain &drain) :
         Link<Buffer>(drain)
@@ -50,6 +54,10 @@ class PacketInfo :
     task<void> Send(const Buffer &data) override {
         co_return co_await Inner().Send(data);
     }
+
+    task<void> Pour(const std::vector<const Buffer *> &data) override {
+        co_return co_await Inner().Pour(data);
+    }
 };
 
 }
@@ -0,0 +1,127 @@
+/* Orchid - WebRTC P2P VPN Market (on Ethereum)
+ * Copyright (C) 2017-2019  The Orchid Authors
+*/
+
+/* GNU Affero General Public License, Version 3 {{{ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+#ifndef ORCHID_SEGMENT_HPP
+#define ORCHID_SEGMENT_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include <boost/endian/conversion.hpp>
+
+#include "buffer.hpp"
+#include "error.hpp"
+
+namespace orc {
+
+// the arithmetic behind Offload, kept apart from the link so it can be checked on its own
+
+inline uint32_t Sum(const uint8_t *data, size_t size, uint32_t sum = 0) {
+    // ones' complement sums don't care about byte order as long as the result is stored back the same way
+    for (; size > 1; data += 2, size -= 2) {
+        uint16_t word;
+        memcpy(&word, data, sizeof(word));
+        sum += word;
+    }
+    if (size != 0) {
+        uint16_t word(0);
+        memcpy(&word, data, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+inline void Fold(uint8_t *field, uint32_t sum) {
+    while ((sum >> 16) != 0)
+        sum = (sum & 0xffff) + (sum >> 16);
+    const uint16_t check(~sum);
+    memcpy(field, &check, sizeof(check));
+}
+
+// the kernel seeded the field at offset (past start) with the pseudo-header; this sums from start to the end
+inline void Complete(uint8_t *data, size_t size, size_t start, size_t offset) {
+    orc_assert(start + offset + 2 <= size);
+    Fold(data + start + offset, Sum(data + start, size - start));
+}
+
+// cuts a TCPv4 super-packet into segments of at most mss bytes of payload, laid out one after another in beam
+inline std::vector<Subset> Segment(Beam &beam, const uint8_t *data, size_t size, size_t mss) {
+    const auto put([](uint8_t *field, auto value) {
+        boost::endian::native_to_big_inplace(value);
+        memcpy(field, &value, sizeof(value));
+    });
+
+    orc_assert(size >= 20 && (data[0] >> 4) == 4 && data[9] == IPPROTO_TCP);
+    const size_t ihl((data[0] & 0xf) * 4);
+    orc_assert(size >= ihl + 20);
+    const size_t headers(ihl + (data[ihl + 12] >> 4) * 4);
+    orc_assert(size >= headers);
+    orc_assert(mss != 0);
+
+    uint16_t id;
+    memcpy(&id, data + 4, sizeof(id));
+    boost::endian::big_to_native_inplace(id);
+    uint32_t sequence;
+    memcpy(&sequence, data + ihl + 4, sizeof(sequence));
+    boost::endian::big_to_native_inplace(sequence);
+
+    const auto stride(headers + mss);
+    const auto count((size - headers + mss - 1) / mss);
+    beam = Beam(stride * count);
+    std::vector<Subset> segments;
+    segments.reserve(count);
+
+    for (size_t offset(headers), index(0); offset < size; offset += mss, ++index) {
+        const auto payload(std::min(mss, size - offset));
+        const auto total(headers + payload);
+        const auto segment(beam.data() + index * stride);
+        memcpy(segment, data, headers);
+        memcpy(segment + headers, data + offset, payload);
+
+        put(segment + 2, uint16_t(total));
+        put(segment + 4, uint16_t(id + index));
+        segment[10] = segment[11] = 0;
+        Fold(segment + 10, Sum(segment, ihl));
+
+        const auto tcp(segment + ihl);
+        put(tcp + 4, uint32_t(sequence + (offset - headers)));
+        // CWR belongs on the first segment; FIN and PSH on the last
+        if (index != 0)
+            tcp[13] &= ~0x80;
+        if (offset + payload != size)
+            tcp[13] &= ~0x09;
+
+        tcp[16] = tcp[17] = 0;
+        const uint8_t pseudo[4] = {0, IPPROTO_TCP, uint8_t((total - ihl) >> 8), uint8_t(total - ihl)};
+        Fold(tcp + 16, Sum(tcp, total - ihl, Sum(pseudo, sizeof(pseudo), Sum(segment + 12, 8))));
+
+        segments.emplace_back(segment, total);
+    }
+
+    return segments;
+}
+
+}
+
+#endif//ORCHID_SEGMENT_HPP
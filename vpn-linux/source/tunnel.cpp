@@ -22,24 +22,57 @@
 
 #include <linux/if_tun.h>
 
+#include "offload.hpp"
 #include "packetinfo.hpp"
+#include "ringfile.hpp"
+#include "spread.hpp"
 #include "syncfile.hpp"
 #include "tunnel.hpp"
 
 namespace orc {
 
-void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code) {
-    auto &family(sunk.Wire<BufferSink<PacketInfo>>());
-    // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
-    auto &sync(family.Wire<SyncFile<asio::posix::stream_descriptor>>(Context(), open("/dev/net/tun", O_RDWR)));
-    auto file(sync->native_handle());
+template <typename File_, typename... Args_>
+static void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code, unsigned queues, bool offload, unsigned batch, Args_ &...args) {
+    auto &spread(offload ?
+        sunk.Wire<BufferSink<Offload>>().Wire<Spread<File_>>(sizeof(virtio_net_hdr)) :
+        sunk.Wire<Spread<File_>>());
+
+    std::string name;
+    for (unsigned i(0); i != queues; ++i) {
+        // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+        const auto file(open("/dev/net/tun", O_RDWR));
+        orc_assert(file != -1);
+        spread.Add(args..., file);
 
-    struct ifreq request = {.ifr_flags = IFF_TUN | IFF_NO_PI};
-    // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
-    orc_assert(ioctl(file, TUNSETIFF, (void *) &request) >= 0);
+        struct ifreq request = {.ifr_flags = short(IFF_TUN | IFF_NO_PI | (queues == 1 ? 0 : IFF_MULTI_QUEUE) | (offload ? IFF_VNET_HDR : 0))};
+        // the first queue lets the kernel pick a name and the rest attach to it
+        name.copy(request.ifr_name, IFNAMSIZ - 1);
+        // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+        orc_assert(ioctl(file, TUNSETIFF, (void *) &request) >= 0);
+        name = request.ifr_name;
 
-    code(request.ifr_name, "dev");
-    sync.Open();
+        if (offload)
+            // XXX: NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+            orc_assert(ioctl(file, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4) >= 0);
+    }
+
+    code(name, "dev");
+    // a TSO super-packet is up to 64k, behind its virtio_net_hdr
+    spread.Open(offload ? 0x10000 + sizeof(virtio_net_hdr) : 2048, batch);
 }
 
+void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code, unsigned queues, bool offload, bool uring, unsigned batch) {
+    orc_assert(queues != 0);
+    orc_assert(batch != 0);
+
+    auto &family(sunk.Wire<BufferSink<PacketInfo>>());
+
+    if (uring && RingFile::Supported())
+        return Tunnel<RingFile>(family, code, queues, offload, batch);
+    if (uring)
+        Log() << "io_uring is not available; falling back to a reader thread per queue" << std::endl;
+
+    auto &context(Context());
+    return Tunnel<SyncFile<asio::posix::stream_descriptor>>(family, code, queues, offload, batch, context);
+}
 }
@@ -43,6 +43,7 @@
 #include "monitor.hpp"
 #include "network.hpp"
 #include "origin.hpp"
+#include "parallel.hpp"
 #include "port.hpp"
 #include "retry.hpp"
 #include "remote.hpp"
@@ -235,6 +236,28 @@ void Capture::Land(const Buffer &data) {
     }; });
 }
 
+void Capture::Flood(const std::vector<const Buffer *> &data) {
+    if (!internal_)
+        return;
+    // one task per batch, rather than one per packet, but with all of its sends in flight at once
+    std::vector<Beam> beams;
+    beams.reserve(data.size());
+    for (const auto item : data)
+        beams.emplace_back(*item);
+    nest_.Hatch([&]() noexcept { return [this, beams = std::move(beams)]() mutable -> task<void> {
+        std::vector<task<bool>> sends;
+        sends.reserve(beams.size());
+        for (const auto &data : beams)
+            sends.emplace_back(internal_->Send(data));
+        auto sent(co_await Parallel(std::move(sends)));
+        for (size_t i(0); i != beams.size(); ++i)
+            orc_ignore({
+                if (*std::move(sent[i]))
+                    analyzer_->Analyze(beams[i].span());
+            });
+    }; });
+}
+
 void Capture::Stop(const std::string &error) noexcept {
     orc_insist_(false, error);
     Valve::Stop();
@@ -71,6 +71,7 @@ class Capture :
 
   protected:
     void Land(const Buffer &data) override;
+    void Flood(const std::vector<const Buffer *> &data) override;
     void Stop(const std::string &error) noexcept override;
 
   public:
@@ -30,7 +30,11 @@
 
 namespace orc {
 
-void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code);
+// queues > 1 opens the device that many times (IFF_MULTI_QUEUE), each with its own reader, where supported
+// offload lets the device hand over TSO super-packets (IFF_VNET_HDR), where supported
+// uring moves packets through io_uring rather than a blocking thread, where the kernel allows it
+// batch > 1 hands up to that many packets read together to the capture in one go, where supported
+void Tunnel(BufferSunk &sunk, const std::function<void (const std::string &, const std::string &)> &code, unsigned queues = 1, bool offload = false, bool uring = false, unsigned batch = 1);
 
 }
 